@@ -77,8 +77,8 @@ void render() {
   pen(0, 0, 0);
   rectangle(0, 0, 240, 50);
   pen(15, 15, 15);
-  text(str(time()), 10, 10);
-  text("battery: " + str(charge(), 2), 10, 30);
+  text(strbuf_t<16>() << time(), 10, 10);
+  text(strbuf_t<32>() << "battery: " << charge(), 10, 30);
 
   uint32_t x = time() / 10000;
   uint32_t y = charge() * 100;
@@ -0,0 +1,34 @@
+#include <cstdint>
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  alignas(8) static uint8_t _frame_arena_data[PICOSYSTEM_FRAME_ARENA_SIZE];
+
+  arena_t _frame_arena{
+    .data = _frame_arena_data, .size = PICOSYSTEM_FRAME_ARENA_SIZE,
+    .used = 0, .high_water = 0
+  };
+
+  void *alloc(arena_t &a, uint32_t size, uint32_t align) {
+    // align must be a power of two
+    uint32_t start = (a.used + align - 1) & ~(align - 1);
+    if(start + size > a.size) {
+      return nullptr;
+    }
+
+    a.used = start + size;
+    a.high_water = std::max(a.high_water, a.used);
+    return a.data + start;
+  }
+
+  void reset(arena_t &a) {
+    a.used = 0;
+  }
+
+  void *frame_alloc(uint32_t size, uint32_t align) {
+    return alloc(_frame_arena, size, align);
+  }
+
+}
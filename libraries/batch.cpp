@@ -0,0 +1,159 @@
+#include <cstdint>
+
+#include "batch.hpp"
+
+namespace picosystem {
+
+  namespace {
+    constexpr uint16_t CULLED = 0xffff;
+
+    // covered 8x8 tiles, a row of 32 per word
+    constexpr int32_t TILE_SHIFT = 3;
+    constexpr int32_t TILES = 32;
+
+    inline uint32_t sort_key(const batch_sprite_t &s) {
+      return (s.layer << 16) | uint16_t(s.key + 32768);
+    }
+
+    // least significant digit radix sort of sprite indices by one byte of
+    // their sort key, passes where every key shares the same byte are skipped
+    uint16_t *radix_pass(const sprite_batch_t &b, uint16_t *in, uint16_t *out, uint32_t shift) {
+      uint32_t counts[256] = {0};
+      for(uint32_t i = 0; i < b.count; i++) {
+        counts[(sort_key(b.sprites[in[i]]) >> shift) & 0xff]++;
+      }
+
+      uint32_t sum = 0;
+      for(uint32_t k = 0; k < 256; k++) {
+        if(counts[k] == b.count) return in;
+        uint32_t c = counts[k];
+        counts[k] = sum;
+        sum += c;
+      }
+
+      for(uint32_t i = 0; i < b.count; i++) {
+        out[counts[(sort_key(b.sprites[in[i]]) >> shift) & 0xff]++] = in[i];
+      }
+
+      return out;
+    }
+
+    // bits for tiles a to b inclusive
+    inline uint32_t tile_mask(int32_t a, int32_t b) {
+      return ((2u << b) - 1) & ~((1u << a) - 1);
+    }
+
+    // true if every tile the rectangle touches is covered
+    bool covered(const uint32_t *tiles, int32_t x, int32_t y, int32_t w, int32_t h) {
+      int32_t tx0 = x >> TILE_SHIFT, tx1 = (x + w - 1) >> TILE_SHIFT;
+      int32_t ty0 = y >> TILE_SHIFT, ty1 = (y + h - 1) >> TILE_SHIFT;
+      if(tx1 >= TILES || ty1 >= TILES) return false;
+
+      uint32_t mask = tile_mask(tx0, tx1);
+      for(int32_t ty = ty0; ty <= ty1; ty++) {
+        if((tiles[ty] & mask) != mask) return false;
+      }
+      return true;
+    }
+
+    // marks the tiles the rectangle covers completely
+    void cover(uint32_t *tiles, int32_t x, int32_t y, int32_t w, int32_t h) {
+      constexpr int32_t size = 1 << TILE_SHIFT;
+      int32_t tx0 = (x + size - 1) >> TILE_SHIFT, tx1 = std::min(((x + w) >> TILE_SHIFT) - 1, TILES - 1);
+      int32_t ty0 = (y + size - 1) >> TILE_SHIFT, ty1 = std::min(((y + h) >> TILE_SHIFT) - 1, TILES - 1);
+      if(tx0 > tx1 || ty0 > ty1) return;
+
+      uint32_t mask = tile_mask(tx0, tx1);
+      for(int32_t ty = ty0; ty <= ty1; ty++) {
+        tiles[ty] |= mask;
+      }
+    }
+  }
+
+  bool batch_sprite(sprite_batch_t &b, const buffer_t &sheet,
+                    int32_t sx, int32_t sy, int32_t w, int32_t h, int32_t x, int32_t y,
+                    uint8_t layer, int32_t key, uint8_t mode, uint8_t flags) {
+    if(b.count == b.capacity) return false;
+
+    // clamp the source rectangle to the sheet once here rather than per draw
+    if(sx < 0) {w += sx; x -= sx; sx = 0;}
+    if(sy < 0) {h += sy; y -= sy; sy = 0;}
+    w = std::min(w, int32_t(sheet.w) - sx);
+    h = std::min(h, int32_t(sheet.h) - sy);
+    if(w <= 0 || h <= 0) return true;
+
+    // anything further out than this is off screen anyway
+    x = std::clamp<int32_t>(x, INT16_MIN, INT16_MAX - w);
+    y = std::clamp<int32_t>(y, INT16_MIN, INT16_MAX - h);
+    key = std::clamp<int32_t>(key, INT16_MIN, INT16_MAX);
+
+    b.sprites[b.count++] = {
+      &sheet, int16_t(sx), int16_t(sy), int16_t(w), int16_t(h), int16_t(x), int16_t(y),
+      int16_t(key), layer, mode, flags
+    };
+    return true;
+  }
+
+  uint32_t draw_batch(sprite_batch_t &b, const blend_func_t *modes) {
+    if(!b.count) return 0;
+
+    uint16_t *order = b.order, *scratch = b.scratch;
+    for(uint32_t i = 0; i < b.count; i++) order[i] = i;
+
+    for(uint32_t shift = 0; shift < 24; shift += 8) {
+      uint16_t *sorted = radix_pass(b, order, scratch, shift);
+      if(sorted == scratch) {
+        scratch = order;
+        order = sorted;
+      }
+    }
+
+    // front to back, anything off screen or behind opaque sprites that are
+    // drawn after it is dropped
+    uint32_t tiles[TILES] = {0};
+    for(uint32_t j = b.count; j--; ) {
+      const batch_sprite_t &s = b.sprites[order[j]];
+      int32_t x = s.x, y = s.y, w = s.w, h = s.h;
+      clip_rect(x, y, w, h);
+
+      if(w <= 0 || h <= 0 || covered(tiles, x, y, w, h)) {
+        order[j] = CULLED;
+      }else if(s.flags & SPRITE_OPAQUE) {
+        cover(tiles, x, y, w, h);
+      }
+    }
+
+    // back to front in runs of the same blend mode
+    blend_func_t bf = _bf;
+    int32_t last_mode = -1;
+    uint32_t drawn = 0;
+
+    for(uint32_t j = 0; j < b.count; j++) {
+      if(order[j] == CULLED) continue;
+      const batch_sprite_t &s = b.sprites[order[j]];
+
+      if(s.mode != last_mode) {
+        last_mode = s.mode;
+        _bf = modes[last_mode];
+      }
+
+      int32_t x = s.x, y = s.y, w = s.w, h = s.h;
+      clip_rect(x, y, w, h);
+
+      pen_t *src = s.sheet->data + (s.sx + x - s.x) + (s.sy + y - s.y) * s.sheet->w;
+      pen_t *dest = _fb.data + offset(x, y);
+      while(h--) {
+        _bf(src, 1, dest, w);
+        src += s.sheet->w;
+        dest += _fb.w;
+      }
+
+      drawn++;
+    }
+
+    _bf = bf;
+    b.count = 0;
+    return drawn;
+  }
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // sprite batches
+  //
+  // sprites are collected over the frame with a layer and a sort key
+  // (usually the y of their feet) and draw_batch() draws them in order of
+  // layer and then key, sprites with equal keys in the order they were
+  // added. the sort is a radix sort into index arrays held by the batch so
+  // it never allocates.
+  //
+  // before drawing, sprites outside the clip rect are dropped and so are
+  // sprites hidden behind SPRITE_OPAQUE ones drawn after them. coverage is
+  // tracked in 8x8 tiles over the top left 256x256 pixels, a tile only
+  // counts as covered once opaque sprites have filled all of it, so tile
+  // aligned occluders (roofs, walls, foreground tiles) work best.
+  enum : uint8_t {
+    SPRITE_OPAQUE = 1 << 0  // every pixel is solid and drawn with a blend
+                            // mode that replaces what's below (e.g. COPY)
+  };
+
+  struct batch_sprite_t {
+    const buffer_t *sheet;
+    int16_t sx, sy, w, h;   // source rectangle in the sheet
+    int16_t x, y;           // where it's drawn
+    int16_t key;
+    uint8_t layer;
+    uint8_t mode;           // index into the blend modes passed to draw_batch()
+    uint8_t flags;
+  };
+
+  struct sprite_batch_t {
+    uint32_t count;
+    uint32_t capacity;
+    batch_sprite_t *sprites;
+    uint16_t *order, *scratch;  // sort space, capacity entries each
+  };
+
+  // sprite_batch_t with storage for N sprites
+  template<uint32_t N>
+  struct sprite_batch_storage_t : sprite_batch_t {
+    static_assert(N < 65536, "sprite batch indices are 16-bit");
+
+    batch_sprite_t storage[N];
+    uint16_t sorder[N], sscratch[N];
+
+    sprite_batch_storage_t() : sprite_batch_t{0, N, storage, sorder, sscratch} {}
+  };
+
+  // adds the sprite at sx, sy (w x h) in sheet to be drawn at x, y. returns
+  // false if the batch is full. the sheet must stay alive until drawn.
+  bool batch_sprite(sprite_batch_t &b, const buffer_t &sheet,
+                    int32_t sx, int32_t sy, int32_t w, int32_t h, int32_t x, int32_t y,
+                    uint8_t layer = 0, int32_t key = 0, uint8_t mode = 0, uint8_t flags = 0);
+
+  // sorts, culls, and draws the batch onto the current target, changing
+  // blend mode only between runs of sprites that use different ones. the
+  // batch is emptied ready for the next frame. returns the number of
+  // sprites drawn.
+  uint32_t draw_batch(sprite_batch_t &b, const blend_func_t *modes);
+
+}
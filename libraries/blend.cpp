@@ -0,0 +1,202 @@
+#include <cstdint>
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // pen_t is stored as ggggbbbbaaaarrrr so with two pixels in a 32-bit word
+  // the r and b channels sit in the even nibbles and a and g in the odd
+  // nibbles. spreading either set into 8-bit lanes leaves headroom for a
+  // carry (or borrow) bit per channel which lets us saturate four channels
+  // with a handful of logic operations.
+  //
+  // every kernel preserves the destination alpha, the same as BLEND.
+
+  namespace {
+    constexpr uint32_t EVEN       = 0x0f0f0f0f; // r and b of two pixels
+    constexpr uint32_t ALPHA_BITS = 0x00f000f0; // alpha of two pixels
+    constexpr uint32_t COLOUR     = 0xff0fff0f; // r, g, and b of two pixels
+    constexpr uint32_t LANE       = 0x000f000f; // one channel of two pixels
+
+    // c * a / 15 rounded to nearest, exact for all 4-bit c and a
+    inline uint32_t scale(uint32_t c, uint32_t a) {
+      return (c * a * 137 + 1024) >> 11;
+    }
+
+    // as scale() but for a pair of products held in 16-bit lanes
+    inline uint32_t div15(uint32_t x) {
+      return ((x * 137 + 0x04000400) >> 11) & LANE;
+    }
+
+    // multiplies the channel at `shift` of two pixels by the matching
+    // channel in f, leaving one product in each 16-bit lane
+    inline uint32_t product(uint32_t d, uint32_t f, uint32_t shift) {
+      uint32_t dc = (d >> shift) & LANE, fc = (f >> shift) & LANE;
+      return ((dc & 0xffff) * (fc & 0xffff)) | (((dc >> 16) * (fc >> 16)) << 16);
+    }
+
+    // per channel d * f / 15 for two pixels, alpha is cleared
+    inline uint32_t multiply(uint32_t d, uint32_t f) {
+      return  div15(product(d, f, 0)) |
+             (div15(product(d, f, 8)) << 8) |
+             (div15(product(d, f, 12)) << 12);
+    }
+
+    // saturating add of 4-bit values held in 8-bit lanes
+    inline uint32_t add_sat(uint32_t a, uint32_t b) {
+      uint32_t s = a + b;
+      uint32_t o = s & 0x10101010; // carry out of each lane
+      return (s | (o - (o >> 4))) & EVEN;
+    }
+
+    // saturating subtract of 4-bit values held in 8-bit lanes
+    inline uint32_t sub_sat(uint32_t a, uint32_t b) {
+      uint32_t d = (a | 0x10101010) - b;
+      uint32_t k = d & 0x10101010; // lanes that did not underflow
+      return d & (k - (k >> 4));
+    }
+
+    // scales the colour channels of a pen by its alpha, alpha is cleared
+    inline uint32_t premultiply(pen_t p) {
+      uint32_t a = (p >> 4) & 0xf;
+      return scale(p & 0xf, a) | (scale((p >> 8) & 0xf, a) << 8) | (scale(p >> 12, a) << 12);
+    }
+
+    struct add_op {
+      static uint32_t prepare(pen_t s) { return premultiply(s); }
+      static uint32_t apply(uint32_t d, uint32_t s) {
+        uint32_t lo = add_sat(d & EVEN, s & EVEN);
+        uint32_t hi = add_sat((d >> 4) & EVEN, (s >> 4) & EVEN);
+        return ((lo | (hi << 4)) & COLOUR) | (d & ALPHA_BITS);
+      }
+    };
+
+    struct subtract_op {
+      static uint32_t prepare(pen_t s) { return premultiply(s); }
+      static uint32_t apply(uint32_t d, uint32_t s) {
+        uint32_t lo = sub_sat(d & EVEN, s & EVEN);
+        uint32_t hi = sub_sat((d >> 4) & EVEN, (s >> 4) & EVEN);
+        return ((lo | (hi << 4)) & COLOUR) | (d & ALPHA_BITS);
+      }
+    };
+
+    struct multiply_op {
+      // fade the factor towards white as alpha drops so that a transparent
+      // source leaves the destination unchanged
+      static uint32_t prepare(pen_t s) {
+        uint32_t a = (s >> 4) & 0xf;
+        return (15 - scale(15 - (s & 0xf), a)) |
+               ((15 - scale(15 - ((s >> 8) & 0xf), a)) << 8) |
+               ((15 - scale(15 - (s >> 12), a)) << 12);
+      }
+      static uint32_t apply(uint32_t d, uint32_t s) {
+        return multiply(d, s) | (d & ALPHA_BITS);
+      }
+    };
+
+    struct screen_op {
+      // 1 - (1 - d) * (1 - s) so we store the inverted source
+      static uint32_t prepare(pen_t s) { return premultiply(s) ^ 0xff0f; }
+      static uint32_t apply(uint32_t d, uint32_t s) {
+        return (multiply(d ^ COLOUR, s) ^ COLOUR) | (d & ALPHA_BITS);
+      }
+    };
+
+    // runs a kernel over a span two pixels at a time, kernels take a pair
+    // of prepared source values in the same layout as the destination
+    template<typename K>
+    void blend_span(pen_t *source, uint32_t source_step, pen_t *dest, uint32_t count) {
+      if(!count) return;
+
+      if(source_step == 0) {
+        // pen drawing, prepare the source once
+        uint32_t s = K::prepare(*source);
+        s |= s << 16;
+
+        // align destination to 32bits
+        if(uintptr_t(dest) & 0b11) {
+          *dest = K::apply(*dest, s);
+          dest++;
+          count--;
+        }
+
+        uint32_t *dwd = (uint32_t *)dest;
+        while(count > 1) {
+          *dwd = K::apply(*dwd, s);
+          dwd++;
+          count -= 2;
+        }
+
+        if(count) {
+          dest = (pen_t *)dwd;
+          *dest = K::apply(*dest, s);
+        }
+      }else{
+        // blits, prepare each source pixel as we go
+        if(uintptr_t(dest) & 0b11) {
+          *dest = K::apply(*dest, K::prepare(*source++));
+          dest++;
+          count--;
+        }
+
+        uint32_t *dwd = (uint32_t *)dest;
+        while(count > 1) {
+          uint32_t s = K::prepare(source[0]) | (K::prepare(source[1]) << 16);
+          *dwd = K::apply(*dwd, s);
+          dwd++;
+          source += 2;
+          count -= 2;
+        }
+
+        if(count) {
+          dest = (pen_t *)dwd;
+          *dest = K::apply(*dest, K::prepare(*source));
+        }
+      }
+    }
+  }
+
+  void ADD(pen_t *source, uint32_t source_step, pen_t *dest, uint32_t count) {
+    blend_span<add_op>(source, source_step, dest, count);
+  }
+
+  void SUBTRACT(pen_t *source, uint32_t source_step, pen_t *dest, uint32_t count) {
+    blend_span<subtract_op>(source, source_step, dest, count);
+  }
+
+  void MULTIPLY(pen_t *source, uint32_t source_step, pen_t *dest, uint32_t count) {
+    blend_span<multiply_op>(source, source_step, dest, count);
+  }
+
+  void SCREEN(pen_t *source, uint32_t source_step, pen_t *dest, uint32_t count) {
+    blend_span<screen_op>(source, source_step, dest, count);
+  }
+
+  void ALPHA(pen_t *source, uint32_t source_step, pen_t *dest, uint32_t count) {
+    // pens are either skipped, copied, or blended in one go
+    if(source_step == 0) {
+      uint8_t a = (*source >> 4) & 0xf;
+      if(a == 0xf) {
+        COPY(source, 0, dest, count);
+      }else if(a) {
+        BLEND(source, 0, dest, count);
+      }
+      return;
+    }
+
+    // blits skip fully transparent pixels and copy fully opaque ones, only
+    // the pixels in between pay for the blend
+    while(count--) {
+      uint8_t a = (*source >> 4) & 0xf;
+      if(a == 0xf) {
+        *dest = *source;
+      }else if(a) {
+        BLEND(source, 0, dest, 1);
+      }
+
+      source++;
+      dest++;
+    }
+  }
+
+}
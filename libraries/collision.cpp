@@ -0,0 +1,221 @@
+#include <cstdint>
+#include <cstring>
+
+#include "collision.hpp"
+
+namespace picosystem {
+
+  spatial_hash_t::spatial_hash_t() : stamp(0) {
+    for(auto &c : cells) c = HASH_NONE;
+    for(auto &o : objects) o.c0 = -1;
+    for(auto &s : stamps) s = 0;
+  }
+
+  static int8_t cell(int32_t v, int32_t limit) {
+    v /= PICOSYSTEM_HASH_CELL_SIZE;
+    return v < 0 ? 0 : (v >= limit ? limit - 1 : v);
+  }
+
+  static void unlink(spatial_hash_t &h, uint16_t id) {
+    hash_object_t &o = h.objects[id];
+    for(int32_t r = o.r0; r <= o.r1; r++) {
+      for(int32_t c = o.c0; c <= o.c1; c++) {
+        uint16_t *link = &h.cells[c + r * HASH_COLUMNS];
+        while(*link != HASH_NONE) {
+          hash_node_t *n = h.nodes.at(*link);
+          if(n->object == id) {
+            *link = n->next;
+            h.nodes.free(n);
+            break;
+          }
+          link = &n->next;
+        }
+      }
+    }
+
+    o.c0 = -1;
+  }
+
+  bool hash_move(spatial_hash_t &h, uint16_t id, int32_t x, int32_t y, int32_t w, int32_t hh) {
+    hash_object_t &o = h.objects[id];
+    o.x = x; o.y = y; o.w = w; o.h = hh;
+
+    int8_t c0 = cell(x, HASH_COLUMNS), c1 = cell(x + w - 1, HASH_COLUMNS);
+    int8_t r0 = cell(y, HASH_ROWS),    r1 = cell(y + hh - 1, HASH_ROWS);
+
+    // most moves stay within the same cells
+    if(o.c0 == c0 && o.c1 == c1 && o.r0 == r0 && o.r1 == r1) {
+      return true;
+    }
+
+    if(o.c0 >= 0) {
+      unlink(h, id);
+    }
+
+    // make sure there are enough nodes to link into every cell
+    uint32_t needed = (c1 - c0 + 1) * (r1 - r0 + 1);
+    if(h.nodes.capacity() - h.nodes.used() < needed) {
+      return false;
+    }
+
+    o.c0 = c0; o.c1 = c1; o.r0 = r0; o.r1 = r1;
+    for(int32_t r = r0; r <= r1; r++) {
+      for(int32_t c = c0; c <= c1; c++) {
+        hash_node_t *n = h.nodes.alloc();
+        uint16_t &head = h.cells[c + r * HASH_COLUMNS];
+        n->object = id;
+        n->next = head;
+        head = h.nodes.index(n);
+      }
+    }
+
+    return true;
+  }
+
+  void hash_remove(spatial_hash_t &h, uint16_t id) {
+    if(h.objects[id].c0 >= 0) {
+      unlink(h, id);
+    }
+  }
+
+  static uint16_t next_stamp(spatial_hash_t &h) {
+    if(++h.stamp == 0) {
+      // wrapped, start over so stale stamps can't match
+      for(auto &s : h.stamps) s = 0;
+      h.stamp = 1;
+    }
+
+    return h.stamp;
+  }
+
+  static bool intersects(const hash_object_t &o, int32_t x, int32_t y, int32_t w, int32_t h) {
+    return o.x < x + w && x < o.x + o.w && o.y < y + h && y < o.y + o.h;
+  }
+
+  uint32_t hash_query(spatial_hash_t &h, int32_t x, int32_t y, int32_t w, int32_t hh, uint16_t *out, uint32_t max) {
+    uint16_t stamp = next_stamp(h);
+    uint32_t count = 0;
+
+    int32_t c0 = cell(x, HASH_COLUMNS), c1 = cell(x + w - 1, HASH_COLUMNS);
+    int32_t r0 = cell(y, HASH_ROWS),    r1 = cell(y + hh - 1, HASH_ROWS);
+    for(int32_t r = r0; r <= r1; r++) {
+      for(int32_t c = c0; c <= c1; c++) {
+        for(uint16_t i = h.cells[c + r * HASH_COLUMNS]; i != HASH_NONE; i = h.nodes.at(i)->next) {
+          uint16_t id = h.nodes.at(i)->object;
+          if(h.stamps[id] == stamp) continue;
+          h.stamps[id] = stamp;
+
+          if(intersects(h.objects[id], x, y, w, hh)) {
+            if(count == max) return count;
+            out[count++] = id;
+          }
+        }
+      }
+    }
+
+    return count;
+  }
+
+  uint32_t hash_query(spatial_hash_t &h, int32_t cx, int32_t cy, int32_t r, uint16_t *out, uint32_t max) {
+    uint32_t count = hash_query(h, cx - r, cy - r, r * 2 + 1, r * 2 + 1, out, max);
+
+    // keep only the objects whose nearest point is within the radius
+    uint32_t kept = 0;
+    for(uint32_t i = 0; i < count; i++) {
+      const hash_object_t &o = h.objects[out[i]];
+      int32_t nx = std::max(o.x, std::min(cx, o.x + o.w - 1));
+      int32_t ny = std::max(o.y, std::min(cy, o.y + o.h - 1));
+      int32_t dx = nx - cx, dy = ny - cy;
+      if(dx * dx + dy * dy <= r * r) {
+        out[kept++] = out[i];
+      }
+    }
+
+    return kept;
+  }
+
+  uint32_t hash_pairs(spatial_hash_t &h, hash_pair_t *out, uint32_t max) {
+    uint32_t count = 0;
+
+    for(int32_t r = 0; r < HASH_ROWS; r++) {
+      for(int32_t c = 0; c < HASH_COLUMNS; c++) {
+        for(uint16_t i = h.cells[c + r * HASH_COLUMNS]; i != HASH_NONE; i = h.nodes.at(i)->next) {
+          uint16_t a = h.nodes.at(i)->object;
+          const hash_object_t &oa = h.objects[a];
+
+          for(uint16_t j = h.nodes.at(i)->next; j != HASH_NONE; j = h.nodes.at(j)->next) {
+            uint16_t b = h.nodes.at(j)->object;
+            const hash_object_t &ob = h.objects[b];
+
+            // objects spanning several cells meet in more than one of
+            // them, only report the pair from the first cell they share
+            if(std::max(oa.c0, ob.c0) != c || std::max(oa.r0, ob.r0) != r) continue;
+            if(!intersects(oa, ob.x, ob.y, ob.w, ob.h)) continue;
+
+            if(count == max) return count;
+            out[count++] = {a, b};
+          }
+        }
+      }
+    }
+
+    return count;
+  }
+
+  mask_t create_mask(const buffer_t &src, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t *bits) {
+    mask_t m{w, h, uint32_t((w + 31) >> 5), bits};
+    memset(bits, 0, mask_words(w, h) * sizeof(uint32_t));
+
+    for(int32_t my = 0; my < h; my++) {
+      const pen_t *s = src.data + x + (y + my) * src.w;
+      uint32_t *row = bits + my * m.stride;
+      for(int32_t mx = 0; mx < w; mx++) {
+        if(s[mx] & 0x00f0) {
+          row[mx >> 5] |= 1u << (mx & 31);
+        }
+      }
+    }
+
+    return m;
+  }
+
+  // 32 pixels of a mask row starting at column x, pixels outside the row
+  // are clear
+  static uint32_t row_bits(const mask_t &m, const uint32_t *row, int32_t x) {
+    if(x <= -32 || x >= m.w) return 0;
+    if(x < 0) return row[0] << -x;
+
+    uint32_t i = x >> 5, s = x & 31;
+    uint32_t v = row[i] >> s;
+    if(s && i + 1 < m.stride) {
+      v |= row[i + 1] << (32 - s);
+    }
+
+    return v;
+  }
+
+  bool overlap(const mask_t &a, int32_t ax, int32_t ay, const mask_t &b, int32_t bx, int32_t by) {
+    // overlapping region in the coordinate space of a
+    int32_t dx = bx - ax, dy = by - ay;
+    int32_t x0 = std::max<int32_t>(0, dx), x1 = std::min(a.w, dx + b.w);
+    int32_t y0 = std::max<int32_t>(0, dy), y1 = std::min(a.h, dy + b.h);
+    if(x0 >= x1 || y0 >= y1) return false;
+
+    for(int32_t y = y0; y < y1; y++) {
+      const uint32_t *ar = a.bits + y * a.stride;
+      const uint32_t *br = b.bits + (y - dy) * b.stride;
+
+      for(int32_t x = x0; x < x1; x += 32) {
+        uint32_t m = row_bits(a, ar, x) & row_bits(b, br, x - dx);
+        if(x1 - x < 32) {
+          m &= (1u << (x1 - x)) - 1;
+        }
+
+        if(m) return true;
+      }
+    }
+
+    return false;
+  }
+
+}
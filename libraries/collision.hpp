@@ -0,0 +1,90 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // broadphase
+  //
+  // a uniform grid over the 240x240 playfield. objects are referred to by
+  // id and linked into every cell their bounds touch, the links come from a
+  // pool so nothing is allocated at runtime. objects partly (or entirely)
+  // off screen are clamped into the edge cells.
+  #ifndef PICOSYSTEM_HASH_CELL_SIZE
+  #define PICOSYSTEM_HASH_CELL_SIZE 16
+  #endif
+
+  #ifndef PICOSYSTEM_HASH_OBJECTS
+  #define PICOSYSTEM_HASH_OBJECTS 512
+  #endif
+
+  #ifndef PICOSYSTEM_HASH_NODES
+  #define PICOSYSTEM_HASH_NODES 2048
+  #endif
+
+  constexpr int32_t HASH_COLUMNS = (240 + PICOSYSTEM_HASH_CELL_SIZE - 1) / PICOSYSTEM_HASH_CELL_SIZE;
+  constexpr int32_t HASH_ROWS    = HASH_COLUMNS;
+  constexpr uint16_t HASH_NONE   = 0xffff;
+
+  struct hash_node_t {
+    uint16_t object;
+    uint16_t next;  // next node in the same cell or HASH_NONE
+  };
+
+  struct hash_object_t {
+    int32_t x, y, w, h;
+    int8_t c0, r0, c1, r1;  // inclusive cell range, c0 < 0 if not inserted
+  };
+
+  struct hash_pair_t {
+    uint16_t a, b;
+  };
+
+  struct spatial_hash_t {
+    uint16_t cells[HASH_COLUMNS * HASH_ROWS];
+    hash_object_t objects[PICOSYSTEM_HASH_OBJECTS];
+    pool_t<hash_node_t, PICOSYSTEM_HASH_NODES> nodes;
+
+    // used to report each object once per query
+    uint16_t stamps[PICOSYSTEM_HASH_OBJECTS];
+    uint16_t stamp;
+
+    spatial_hash_t();
+  };
+
+  // inserts or moves an object, only relinking it if the set of cells it
+  // touches has changed. returns false (leaving the object out of the
+  // hash) if the node pool is exhausted.
+  bool hash_move(spatial_hash_t &h, uint16_t id, int32_t x, int32_t y, int32_t w, int32_t hh);
+  void hash_remove(spatial_hash_t &h, uint16_t id);
+
+  // collect the ids of objects whose bounds overlap the rectangle or circle,
+  // returns the number written to out
+  uint32_t hash_query(spatial_hash_t &h, int32_t x, int32_t y, int32_t w, int32_t hh, uint16_t *out, uint32_t max);
+  uint32_t hash_query(spatial_hash_t &h, int32_t cx, int32_t cy, int32_t r, uint16_t *out, uint32_t max);
+
+  // every pair of objects with overlapping bounds, each reported once
+  uint32_t hash_pairs(spatial_hash_t &h, hash_pair_t *out, uint32_t max);
+
+  // narrowphase
+  //
+  // 1bpp collision masks, one bit per pixel with the leftmost pixel of each
+  // 32 pixel group in bit 0 so that overlaps are tested 32 pixels at a time
+  struct mask_t {
+    int32_t w, h;
+    uint32_t stride;  // 32-bit words per row
+    uint32_t *bits;
+  };
+
+  constexpr uint32_t mask_words(int32_t w, int32_t h) {
+    return uint32_t((w + 31) >> 5) * h;
+  }
+
+  // builds a mask from the pixels of src with a non-zero alpha, bits must
+  // have room for mask_words(w, h) words
+  mask_t create_mask(const buffer_t &src, int32_t x, int32_t y, int32_t w, int32_t h, uint32_t *bits);
+
+  // true if any set pixels overlap with the masks at the given positions
+  bool overlap(const mask_t &a, int32_t ax, int32_t ay, const mask_t &b, int32_t bx, int32_t by);
+
+}
@@ -0,0 +1,38 @@
+#include <cstdint>
+
+#include "colour.hpp"
+
+namespace picosystem {
+
+  const std::array<pen_t, 256> HUE_WHEEL = hsv_table<256>(255, 255);
+
+  namespace {
+    // every 8-bit value mapped to its level, a lookup is cheaper than the
+    // multiply and shift when converting whole images
+    constexpr std::array<uint8_t, 256> levels() {
+      std::array<uint8_t, 256> table{};
+      for(uint32_t i = 0; i < 256; i++) {
+        table[i] = level_from_8bit(i);
+      }
+      return table;
+    }
+
+    constexpr std::array<uint8_t, 256> LEVELS = levels();
+  }
+
+  void convert_rgb888(const uint8_t *src, pen_t *dest, uint32_t count) {
+    while(count--) {
+      *dest++ = LEVELS[src[0]] | 0xf0 | (LEVELS[src[2]] << 8) | (LEVELS[src[1]] << 12);
+      src += 3;
+    }
+  }
+
+  void convert_rgba8888(const uint8_t *src, pen_t *dest, uint32_t count) {
+    while(count--) {
+      *dest++ =  LEVELS[src[0]]       | (LEVELS[src[3]] << 4) |
+                (LEVELS[src[2]] << 8) | (LEVELS[src[1]] << 12);
+      src += 4;
+    }
+  }
+
+}
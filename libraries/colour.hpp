@@ -0,0 +1,74 @@
+#pragma once
+
+#include <array>
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // colour conversion
+  //
+  // everything here is integer only and constexpr so that constant colours
+  // and whole tables are worked out by the compiler and land in flash, with
+  // no float maths or table building at startup.
+
+  // 8-bit channel to the nearest 4-bit level, the same as (c * 15 + 127) / 255
+  // but without a divide
+  constexpr uint8_t level_from_8bit(uint8_t c) {
+    return (c * 15 + 135) >> 8;
+  }
+
+  constexpr pen_t pen_from_rgb888(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255) {
+    return  level_from_8bit(r)       | (level_from_8bit(a) << 4) |
+           (level_from_8bit(b) << 8) | (level_from_8bit(g) << 12);
+  }
+
+  // hue, saturation, and value all 0-255 with a hue of 256 being a full
+  // turn of the colour wheel (so it wraps by simply overflowing)
+  constexpr pen_t hsv_pen(uint8_t h, uint8_t s, uint8_t v, uint8_t a = 255) {
+    // x / 255 rounded to nearest for x up to 255 * 255
+    auto div255 = [](uint32_t x) { x += 128; return (x + (x >> 8)) >> 8; };
+
+    uint32_t sector = (h * 6) >> 8;       // 0-5
+    uint32_t f = (h * 6) & 0xff;          // position within the sector
+    uint8_t p = v - div255(v * s);
+    uint8_t q = v - div255(v * div255(s * f));
+    uint8_t t = v - div255(v * div255(s * (255 - f)));
+
+    switch(sector) {
+      case 0:  return pen_from_rgb888(v, t, p, a);
+      case 1:  return pen_from_rgb888(q, v, p, a);
+      case 2:  return pen_from_rgb888(p, v, t, a);
+      case 3:  return pen_from_rgb888(p, q, v, a);
+      case 4:  return pen_from_rgb888(t, p, v, a);
+      default: return pen_from_rgb888(v, p, q, a);
+    }
+  }
+
+  // n evenly spaced hues at a fixed saturation and value, e.g.
+  //
+  //   constexpr auto rainbow = hsv_table<120>(255, 255);
+  //
+  // builds the table at compile time
+  template<size_t N>
+  constexpr std::array<pen_t, N> hsv_table(uint8_t s, uint8_t v, uint8_t a = 255) {
+    std::array<pen_t, N> table{};
+    for(size_t i = 0; i < N; i++) {
+      table[i] = hsv_pen(uint8_t(i * 256 / N), s, v, a);
+    }
+    return table;
+  }
+
+  // fully saturated colour wheel indexed by an 8-bit hue
+  extern const std::array<pen_t, 256> HUE_WHEEL;
+
+  inline pen_t hue_pen(uint8_t h) {
+    return HUE_WHEEL[h];
+  }
+
+  // bulk conversion of packed rgb (3 bytes per pixel) or rgba (4 bytes per
+  // pixel) image data, e.g. assets decoded at runtime
+  void convert_rgb888(const uint8_t *src, pen_t *dest, uint32_t count);
+  void convert_rgba8888(const uint8_t *src, pen_t *dest, uint32_t count);
+
+}
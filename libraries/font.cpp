@@ -1,5 +1,6 @@
 #include <math.h>
 #include <cstring>
+#include <algorithm>
 
 #include "picosystem.hpp"
 
@@ -318,4 +319,151 @@ namespace picosystem {
       { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00}    // U+007F
   };
 
+  const font_t *_font = nullptr;
+
+  void font(const font_t *f) {
+    _font = f;
+  }
+
+  // decodes the next codepoint from a utf-8 string and advances p past it,
+  // malformed sequences decode as U+FFFD
+  uint32_t utf8_next(const char *&p, const char *end) {
+    uint8_t c = *p++;
+    if(c < 0x80) return c;
+
+    uint32_t extra = c >= 0xf0 ? 3 : c >= 0xe0 ? 2 : c >= 0xc0 ? 1 : 0;
+    if(!extra || extra > uint32_t(end - p)) return 0xfffd;
+
+    uint32_t cp = c & (0x3f >> extra);
+    while(extra--) {
+      c = *p;
+      if((c & 0xc0) != 0x80) return 0xfffd;
+      cp = (cp << 6) | (c & 0x3f);
+      p++;
+    }
+
+    return cp;
+  }
+
+  const glyph_t *find_glyph(const font_t *f, uint32_t codepoint) {
+    // binary search the glyph table
+    int32_t lo = 0, hi = f->glyph_count - 1;
+    while(lo <= hi) {
+      int32_t mid = (lo + hi) >> 1;
+      uint32_t c = f->glyphs[mid].codepoint;
+      if(c == codepoint) return &f->glyphs[mid];
+      if(c < codepoint) lo = mid + 1; else hi = mid - 1;
+    }
+
+    return nullptr;
+  }
+
+  int8_t kerning(const font_t *f, uint32_t left, uint32_t right) {
+    int32_t lo = 0, hi = f->kerning_count - 1;
+    while(lo <= hi) {
+      int32_t mid = (lo + hi) >> 1;
+      const kerning_t &k = f->kerning[mid];
+      if(k.left == left && k.right == right) return k.adjust;
+      if(k.left < left || (k.left == left && k.right < right)) lo = mid + 1; else hi = mid - 1;
+    }
+
+    return 0;
+  }
+
+  // draws a glyph's rows of runs, each run is clipped horizontally and then
+  // handed to the blend function as a single span
+  void glyph(const font_t *f, const glyph_t *g, int32_t x, int32_t y) {
+    x += g->x;
+    y += g->y;
+
+    // trivially reject glyphs outside of the clip rect
+    if(x >= _cx + _cw || x + g->w <= _cx || y >= _cy + _ch || y + g->h <= _cy) {
+      return;
+    }
+
+    const uint8_t *r = f->runs + g->runs;
+    for(int32_t row = y; row < y + g->h; row++) {
+      uint8_t count = *r++;
+
+      if(row < _cy || row >= _cy + _ch) {
+        r += count * 2;
+        continue;
+      }
+
+      int32_t rx = x;
+      pen_t *line = _fb.data + offset(0, row);
+      while(count--) {
+        int32_t s = rx + r[0];
+        int32_t e = s + r[1];
+        r += 2;
+        rx = e;
+
+        s = std::max(s, _cx);
+        e = std::min(e, _cx + _cw);
+        if(s < e) {
+          _bf(&_pen, 0, line + s, e - s);
+        }
+      }
+    }
+  }
+
+  void text(const font_t *f, std::string_view t, int32_t x, int32_t y) {
+    const char *p = t.data(), *end = p + t.length();
+    int32_t cx = x;
+    uint32_t previous = 0;
+
+    while(p < end) {
+      uint32_t c = utf8_next(p, end);
+
+      if(c == '\n') {
+        cx = x;
+        y += f->height;
+        previous = 0;
+        continue;
+      }
+
+      const glyph_t *g = find_glyph(f, c);
+      if(!g) g = find_glyph(f, '?');
+      if(!g) continue;
+
+      if(previous) cx += kerning(f, previous, c);
+      glyph(f, g, cx, y);
+      cx += g->advance;
+      previous = c;
+    }
+  }
+
+  int32_t measure(std::string_view t) {
+    const char *p = t.data(), *end = p + t.length();
+    int32_t w = 0, mw = 0;
+    uint32_t previous = 0;
+
+    while(p < end) {
+      uint32_t c = utf8_next(p, end);
+
+      if(c == '\n') {
+        mw = std::max(w, mw);
+        w = 0;
+        previous = 0;
+        continue;
+      }
+
+      if(!_font) {
+        // built in font has a fixed advance
+        w += c == ' ' ? 5 : 9;
+        continue;
+      }
+
+      const glyph_t *g = find_glyph(_font, c);
+      if(!g) g = find_glyph(_font, '?');
+      if(!g) continue;
+
+      if(previous) w += kerning(_font, previous, c);
+      w += g->advance;
+      previous = c;
+    }
+
+    return std::max(w, mw);
+  }
+
 }
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include <cstdint>
+
+#include "governor.hpp"
+
+namespace picosystem {
+
+  namespace {
+    bool _enabled = false;
+    governor_t _governor;
+  }
+
+  uint8_t governor_update(governor_t &g, uint32_t busy_us, uint32_t frame_us) {
+    if(!frame_us) return g.level;
+
+    uint32_t sample = std::min<uint32_t>((uint64_t(busy_us) << 8) / frame_us, 512);
+
+    // exponential moving average, new samples weighted 1/8
+    g.load = uint16_t(int32_t(g.load) + ((int32_t(sample) - int32_t(g.load)) >> 3));
+
+    if(g.hold) g.hold--;
+
+    if((sample >= 256 || g.load >= GOVERNOR_UP) && g.level > 0) {
+      // the busy time shrinks at the faster clock, rescale so that we don't
+      // immediately step down again
+      g.load = uint16_t(g.load * CLOCK_LEVELS[g.level] / CLOCK_LEVELS[g.level - 1]);
+      g.level--;
+      g.hold = GOVERNOR_HOLD;
+    }else if(g.level < CLOCK_LEVEL_COUNT - 1 && !g.hold) {
+      uint32_t scaled = g.load * CLOCK_LEVELS[g.level] / CLOCK_LEVELS[g.level + 1];
+      if(scaled < GOVERNOR_DOWN) {
+        g.load = uint16_t(scaled);
+        g.level++;
+        g.hold = GOVERNOR_HOLD;
+      }
+    }
+
+    return g.level;
+  }
+
+  void governor(bool enabled) {
+    // either way the governor starts again from the fastest level
+    if(_governor.level != 0) {
+      set_clock(CLOCK_LEVELS[0]);
+    }
+
+    _enabled = enabled;
+    _governor = governor_t();
+  }
+
+  void governor_frame(uint32_t busy_us, uint32_t frame_us) {
+    if(!_enabled) return;
+
+    uint8_t level = _governor.level;
+    if(governor_update(_governor, busy_us, frame_us) != level) {
+      set_clock(CLOCK_LEVELS[_governor.level]);
+    }
+  }
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // clock governor
+  //
+  // measures how much of each frame update() and render() keep the cpu busy
+  // and moves the system clock between a few fixed levels to match. the
+  // policy is a pure function of the measurements so it can be exercised
+  // off device, only governor_frame() touches the hardware.
+  //
+  // load is kept as a smoothed fraction of the frame in 1/256ths. a frame
+  // that overruns (or a load above GOVERNOR_UP) steps straight up a level,
+  // while stepping down waits until the load scaled to the slower clock has
+  // stayed under GOVERNOR_DOWN for GOVERNOR_HOLD frames.
+  //
+  // the screen pio needs a whole number divider down to at most 125mhz, so
+  // between 125mhz and 250mhz it runs slower than at either. 150mhz would
+  // take 18.4ms to send a frame which is too long for 60hz.
+  constexpr uint32_t CLOCK_LEVELS[] = {250000, 200000, 125000};
+  constexpr uint8_t  CLOCK_LEVEL_COUNT = sizeof(CLOCK_LEVELS) / sizeof(CLOCK_LEVELS[0]);
+
+  constexpr uint32_t GOVERNOR_UP   = 230; // 90%
+  constexpr uint32_t GOVERNOR_DOWN = 192; // 75%
+  constexpr uint32_t GOVERNOR_HOLD = 60;
+
+  struct governor_t {
+    uint8_t level = 0;    // index into CLOCK_LEVELS, 0 is the fastest
+    uint16_t load = 0;    // smoothed busy fraction of the frame, 256 = 100%
+    uint16_t hold = GOVERNOR_HOLD; // frames before the next step down
+  };
+
+  // folds one frame's measurements into the governor and returns the clock
+  // level to use from now on
+  uint8_t governor_update(governor_t &g, uint32_t busy_us, uint32_t frame_us);
+
+  // off by default, when disabled the clock returns to the fastest level
+  void governor(bool enabled);
+
+  // called by the main loop at the end of each frame
+  void governor_frame(uint32_t busy_us, uint32_t frame_us);
+
+  // sets the system clock and retunes the screen and pwm to suit, provided
+  // by the hal
+  void set_clock(uint32_t khz);
+
+}
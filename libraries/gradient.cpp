@@ -0,0 +1,184 @@
+#include <cstdint>
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // pens only have 4 bits per channel so smooth ramps are drawn with an
+  // ordered dither. colours are worked out in 1/16ths of a pen level and the
+  // bayer threshold for the pixel decides whether the fraction rounds up,
+  // which gives 256 apparent levels per channel.
+
+  bool _dither = false;
+
+  namespace {
+    constexpr uint8_t BAYER[4][4] = {
+      { 0,  8,  2, 10},
+      {12,  4, 14,  6},
+      { 3, 11,  1,  9},
+      {15,  7, 13,  5}
+    };
+
+    // rows are shaded into a small buffer a chunk at a time and then drawn
+    // with the current blend function
+    constexpr int32_t CHUNK = 64;
+
+    pen_t _dither_tile[4][4];
+
+    // channels in pen order (r, a, b, g) in 1/16ths of a level
+    struct ramp_t {
+      int32_t base[4];
+      int32_t delta[4];
+    };
+
+    ramp_t make_ramp(pen_t from, pen_t to) {
+      ramp_t r;
+      for(uint32_t i = 0; i < 4; i++) {
+        int32_t a = (from >> (i * 4)) & 0xf, b = (to >> (i * 4)) & 0xf;
+        r.base[i] = a * 16;
+        r.delta[i] = (b - a) * 16;
+      }
+      return r;
+    }
+
+    // t is the position along the ramp in 16.16 (0 to 1)
+    inline pen_t shade(const ramp_t &r, int32_t t, uint32_t threshold) {
+      pen_t p = 0;
+      for(uint32_t i = 0; i < 4; i++) {
+        int32_t v = r.base[i] + ((r.delta[i] * t) >> 16);
+        p |= ((v + threshold) >> 4) << (i * 4);
+      }
+      return p;
+    }
+
+    // fills a clipped rectangle, row(out, x, y, n) shades n pixels of the
+    // row at y starting at x
+    template<typename F>
+    void shade_rect(int32_t x, int32_t y, int32_t w, int32_t h, F row) {
+      clip_rect(x, y, w, h);
+
+      alignas(4) pen_t buffer[CHUNK];
+      for(int32_t j = 0; j < h; j++) {
+        pen_t *dest = _fb.data + offset(x, y + j);
+        for(int32_t i = 0; i < w; i += CHUNK) {
+          int32_t n = std::min(CHUNK, w - i);
+          row(buffer, x + i, y + j, n);
+          _bf(buffer, 1, dest + i, n);
+        }
+      }
+    }
+
+    // writes n pixels two to a word, p(x) gives the pixel at x
+    template<typename F>
+    void pairs(pen_t *out, int32_t x, int32_t n, F p) {
+      uint32_t *o = (uint32_t *)out;
+      int32_t i = 0;
+      for(; i + 1 < n; i += 2) {
+        uint32_t a = p(x + i);
+        *o++ = a | (uint32_t(p(x + i + 1)) << 16);
+      }
+
+      if(i < n) {
+        out[i] = p(x + i);
+      }
+    }
+
+    uint32_t isqrt(uint32_t v) {
+      uint32_t r = 0, b = 1U << 30;
+      while(b > v) b >>= 2;
+      while(b) {
+        if(v >= r + b) {
+          v -= r + b;
+          r = (r >> 1) + b;
+        }else{
+          r >>= 1;
+        }
+        b >>= 2;
+      }
+      return r;
+    }
+  }
+
+  void linear_gradient(int32_t x, int32_t y, int32_t w, int32_t h,
+                       int32_t x0, int32_t y0, pen_t from, int32_t x1, int32_t y1, pen_t to) {
+    ramp_t ramp = make_ramp(from, to);
+
+    // t is the projection of the pixel onto the gradient vector, stepped
+    // across each row
+    int32_t dx = x1 - x0, dy = y1 - y0;
+    int64_t length2 = int64_t(dx) * dx + int64_t(dy) * dy;
+    if(!length2) length2 = 1;
+    int32_t step = int32_t(int64_t(dx) * 65536 / length2);
+
+    shade_rect(x, y, w, h, [&](pen_t *out, int32_t rx, int32_t ry, int32_t n) {
+      int32_t t = int32_t((int64_t(rx - x0) * dx + int64_t(ry - y0) * dy) * 65536 / length2);
+      const uint8_t *bayer = BAYER[ry & 3];
+      pairs(out, rx, n, [&](int32_t px) {
+        pen_t p = shade(ramp, std::clamp<int32_t>(t, 0, 65536), bayer[px & 3]);
+        t += step;
+        return p;
+      });
+    });
+  }
+
+  void radial_gradient(int32_t x, int32_t y, int32_t w, int32_t h,
+                       int32_t cx, int32_t cy, int32_t radius, pen_t inner, pen_t outer) {
+    ramp_t ramp = make_ramp(inner, outer);
+
+    // distances are in quarter pixels. the distance changes by at most one
+    // pixel between neighbours so the square root is tracked incrementally
+    // from the previous pixel rather than recalculated.
+    int32_t r4 = std::max<int32_t>(radius, 1) * 4;
+    uint32_t inv = (1U << 24) / r4;
+
+    shade_rect(x, y, w, h, [&](pen_t *out, int32_t rx, int32_t ry, int32_t n) {
+      int32_t ddy = (ry - cy) * 4;
+      int32_t ddx = (rx - cx) * 4;
+      uint32_t d2 = ddx * ddx + ddy * ddy;
+      uint32_t s = isqrt(d2);
+      const uint8_t *bayer = BAYER[ry & 3];
+      pairs(out, rx, n, [&](int32_t px) {
+        while((s + 1) * (s + 1) <= d2) s++;
+        while(s * s > d2) s--;
+
+        int32_t t = int32_t((std::min<uint32_t>(s, r4) * inv) >> 8);
+        pen_t p = shade(ramp, t, bayer[px & 3]);
+
+        // step to the next pixel, (d + 4)^2 = d^2 + 8d + 16
+        d2 += 8 * ddx + 16;
+        ddx += 4;
+        return p;
+      });
+    });
+  }
+
+  void dither_pen(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+    // each channel in 1/16ths of a pen level
+    int32_t v[4] = {
+      (r * 240 + 127) / 255, (a * 240 + 127) / 255,
+      (b * 240 + 127) / 255, (g * 240 + 127) / 255
+    };
+
+    for(uint32_t y = 0; y < 4; y++) {
+      for(uint32_t x = 0; x < 4; x++) {
+        pen_t p = 0;
+        for(uint32_t i = 0; i < 4; i++) {
+          p |= ((v[i] + BAYER[y][x]) >> 4) << (i * 4);
+        }
+        _dither_tile[y][x] = p;
+      }
+    }
+
+    // anything drawn without the dither gets the nearest plain pen
+    _pen = create_pen((r * 15 + 127) / 255, (g * 15 + 127) / 255, (b * 15 + 127) / 255, (a * 15 + 127) / 255);
+    _dither = true;
+  }
+
+  void dither_rectangle(int32_t x, int32_t y, int32_t w, int32_t h) {
+    shade_rect(x, y, w, h, [](pen_t *out, int32_t rx, int32_t ry, int32_t n) {
+      const pen_t *tile = _dither_tile[ry & 3];
+      pairs(out, rx, n, [tile](int32_t px) { return tile[px & 3]; });
+    });
+  }
+
+}
@@ -6,6 +6,8 @@
 #include "hardware/pwm.h"
 #include "hardware/pio.h"
 #include "hardware/irq.h"
+#include "hardware/sync.h"
+#include "hardware/flash.h"
 
 #include "pico/bootrom.h"
 #include "pico/stdlib.h"
@@ -13,6 +15,9 @@
 
 #include "screen.pio.h"
 #include "picosystem.hpp"
+#include "save.hpp"
+#include "governor.hpp"
+#include "packed.hpp"
 
 namespace picosystem {
 
@@ -57,8 +62,11 @@ namespace picosystem {
     return to_us_since_boot(t);
   }
 
-  bool pressed(uint32_t button) {
-    return !gpio_get(button);
+  uint32_t read_buttons() {
+    // buttons pull their pins low when pressed
+    const uint32_t mask = (1U << A) | (1U << B) | (1U << X) | (1U << Y) |
+                          (1U << UP) | (1U << DOWN) | (1U << LEFT) | (1U << RIGHT);
+    return ~gpio_get_all() & mask;
   }
 
   void reset_to_dfu() {
@@ -90,7 +98,35 @@ PIO   screen_pio  = pio0;
 uint  screen_sm   = 0;
 
 uint32_t         dma_channel;
-volatile int16_t dma_scanline = -1;
+
+// set by flip() and cleared by the vsync interrupt once it has started the
+// dma transfer of the framebuffer to the screen
+volatile bool     flip_pending = false;
+volatile uint32_t vsync_count = 0;
+
+// post processing in the scanout sends the frame a line at a time from a
+// pair of line buffers, each line is transformed while the one before it is
+// being sent so the framebuffer itself is left untouched
+pen_t             scanout_lines[2][240];
+volatile uint32_t scanout_line = 0;
+volatile bool     scanout_active = false;
+
+// a packed framebuffer is sent with its own pio program which streams every
+// bit, the state machine is switched over between frames
+const packed_buffer_t *packed_screen = nullptr;
+uint              screen_offset;
+uint              screen_packed_offset;
+uint32_t          screen_clkdiv = 2 << 8; // 8.8 fixed point
+
+// when skipping unchanged frames a second dma channel reads the framebuffer
+// through the sniffer as soon as flip() is called. it computes the same crc32
+// as picosystem::crc32() and runs at memory speed so it's long finished by
+// the time the vsync interrupt decides whether to send the frame at all
+int               sniff_channel = -1;
+uint32_t          sniff_sink;
+bool              skip_unchanged_frames = false;
+bool              last_crc_valid = false;
+uint32_t          last_crc;
 
 enum st7789 {
   SWRESET   = 0x01,
@@ -133,72 +169,110 @@ void st7789_command(uint8_t command, size_t len = 0, const char *data = NULL) {
   gpio_put(pin::CS, 1);
 }
 
-// scanline data is sent via dma to the pixel doubling pio program which then
-// writes the data to the st7789 via an spi-like interface. the pio program
-// doubles pixels horizontally, but we need to double them vertically by sending
-// each scanline to the pio twice.
-//
-// to minimise the number of dma transfers we transmit the current scanline and
-// the previous scanline in every transfer. the exceptions are the first and final
-// scanlines which are sent on their own to start and complete the write.
+// the framebuffer is sent to the screen via dma to the pio program which
+// writes the data to the st7789 via an spi-like interface.
 //
-// - transfer #1: scanline 0
-// - transfer #2: scanline 0 + scanline 1
-// - transfer #3: scanline 1 + scanline 2
-// ...
-// - transfer #n - 1: scanline (n - 1) + scanline n
-// - transfer #n: scanline n
-
-// sets up dma transfer for current and previous scanline (except for
-// scanlines 0 and 120 which are sent on their own.)
-/*void transmit_scanline() {
-  // start of data to transmit
-  uint32_t *s = (uint32_t *)&dma_buffer[
-    ((dma_scanline - 1) < 0 ? 0 : (dma_scanline - 1)) * 240
-  ];
-  // number of 32-bit words to transmit
-  uint16_t c = (dma_scanline == 0 || dma_scanline == 120) ? 60 : 120;
-  dma_channel_set_trans_count(dma_channel, c, false);
-  dma_channel_set_read_addr(dma_channel, s, true);
-}*/
-
-//volatile bool dma_active = false;
-
-// once the dma transfer of the scanline is complete we move to the
-// next scanline (or quit if we're finished)
+// to avoid tearing the transfer must begin at the start of the vsync period.
+// rather than spinning on the vsync pin flip() marks a transfer as pending and
+// the vsync interrupt kicks off the dma. once the dma completes its interrupt
+// wakes the main loop if it is sleeping while waiting to render.
+
+// post processes line y of the screen into its line buffer
+static void scanout_prepare(uint32_t y) {
+  const buffer_t &fb = _screen.buffer;
+  post_line(fb.data + y * fb.w, scanout_lines[y & 1], fb.w);
+}
+
+// once the dma transfer of the framebuffer is complete we signal an event
+// to wake up the main loop
 void __isr dma_complete() {
   if (dma_hw->ints0 & (1u << dma_channel)) {
     dma_hw->ints0 = (1u << dma_channel); // clear irq flag
 
-//    dma_active = false;
+    if(scanout_active) {
+      // send the line prepared last time and prepare the one after it
+      const buffer_t &fb = _screen.buffer;
+      uint32_t y = scanout_line + 1;
+      if(y < fb.h) {
+        scanout_line = y;
+        dma_channel_transfer_from_buffer_now(dma_channel, scanout_lines[y & 1], fb.w / 2);
+        if(y + 1 < fb.h) {
+          scanout_prepare(y + 1);
+        }
+      }else{
+        scanout_active = false;
+      }
+    }
+
+    __sev();
   }
 }
 
-// when vsync is triggered we request the first scanline to be transferred
-/*void on_vsync(uint gpio, uint32_t events) {
-  if(dma_scanline != -1) { // already updating, skip
-    return;
+// when vsync is triggered we start the pending framebuffer transfer (if any)
+void on_vsync(uint gpio, uint32_t events) {
+  vsync_count = vsync_count + 1;
+
+  if(flip_pending && !dma_channel_is_busy(dma_channel)) {
+    flip_pending = false;
+
+    bool post_lines = post_in_scanout() && !packed_screen;
+
+    if(skip_unchanged_frames && post_lines) {
+      // the crc is of the frame before post processing so can't be used
+      dma_channel_wait_for_finish_blocking(sniff_channel);
+      dma_sniffer_disable();
+      last_crc_valid = false;
+    }else if(skip_unchanged_frames) {
+      dma_channel_wait_for_finish_blocking(sniff_channel);
+      uint32_t crc = dma_hw->sniff_data;
+      dma_sniffer_disable();
+
+      // the panel keeps showing the last frame, nothing to send
+      if(last_crc_valid && crc == last_crc) {
+        __sev();
+        return;
+      }
+
+      last_crc = crc;
+      last_crc_valid = true;
+    }
+
+    // always the screen buffer, not whichever render target is active
+    const buffer_t &fb = _screen.buffer;
+    if(packed_screen) {
+      const packed_buffer_t &pb = *packed_screen;
+      dma_channel_transfer_from_buffer_now(dma_channel, pb.data, packed_size(pb.w, pb.h) / 4);
+    }else if(post_lines) {
+      scanout_prepare(0);
+      scanout_line = 0;
+      scanout_active = true;
+      dma_channel_transfer_from_buffer_now(dma_channel, scanout_lines[0], fb.w / 2);
+      scanout_prepare(1);
+    }else{
+      uint32_t transfer_count = fb.w * fb.h / 2;
+      dma_channel_transfer_from_buffer_now(dma_channel, fb.data, transfer_count);
+    }
   }
-  // transmit first scanline
-  dma_scanline = 0;
-  transmit_scanline();
-}*/
 
-static inline void screen_program_init(PIO pio, uint sm, uint offset) {
+  __sev();
+}
+
+static inline void screen_program_init(PIO pio, uint sm, uint offset, bool packed) {
   pio_sm_set_consecutive_pindirs(pio, sm, pin::MOSI, 2, true);
 
-  pio_sm_config c = screen_program_get_default_config(offset);
+  pio_sm_config c = packed ? screen_packed_program_get_default_config(offset)
+                           : screen_program_get_default_config(offset);
 
-  // osr shifts left, autopull off, autopull threshold 32
-  sm_config_set_out_shift(&c, false, false, 16);
+  // osr shifts left, autopull on, autopull threshold 32
+  sm_config_set_out_shift(&c, false, true, 32);
 
   // configure out, set, and sideset pins
   sm_config_set_out_pins(&c, pin::MOSI, 1);
   sm_config_set_sideset_pins(&c, pin::SCK);
 
-  // dividing the clock by two ensures we keep the spi transfer to
-  // around 62.5mhz as per the st7789 datasheet
-  sm_config_set_clkdiv_int_frac(&c, 2, 1);
+  // two cycles per bit so the pio runs at up to 125mhz to keep the spi
+  // clock within the st7789's 62.5mhz (retuned along with the system clock)
+  sm_config_set_clkdiv_int_frac(&c, screen_clkdiv >> 8, screen_clkdiv & 0xff);
 
   pio_sm_set_pins_with_mask(pio, sm, 0, (1u << pin::SCK) | (1u << pin::MOSI));
   pio_sm_set_pindirs_with_mask(pio, sm, (1u << pin::SCK) | (1u << pin::MOSI), (1u << pin::SCK) | (1u << pin::MOSI));
@@ -214,56 +288,406 @@ static inline void screen_program_init(PIO pio, uint sm, uint offset) {
 }
 
   void wait_vsync() {
-    // since the SPI transfer is a touch slower than the screen refresh
-    // rate we'll end up with an effective 30fps currently, this can be
-    // improved by moving the LCD SPI transfers into PIO
-    while(gpio_get(pin::VSYNC))  {}  // if in vsync already need to wait for it to end
-    while(!gpio_get(pin::VSYNC)) {}  // now wait for vsync to occur
+    // sleep until the vsync interrupt has fired
+    uint32_t start = vsync_count;
+    while(vsync_count == start) {
+      __wfe();
+    }
   }
 
-  bool is_flipping() {return dma_channel_is_busy(dma_channel);}
-  void flip() {
-    // wait for start of vsync period
-   // wait_vsync();
-    // take a copy of the framebuffer (this takes < 1ms) so that
-    // we can dma transfer over once vsync occurs without any
-    // tearing it costs us around 28kb - yolo
+  void idle() {
+    __wfe();
+  }
+
+  bool is_flipping() {
+    return flip_pending || scanout_active || dma_channel_is_busy(dma_channel);
+  }
+
+  // a line by line scanout needs the cpu between lines so doesn't count
+  bool is_transferring() {
+    return dma_channel_is_busy(dma_channel) && !scanout_active;
+  }
 
-    //
+  // the save region is the last few sectors of flash. while erasing or
+  // programming, flash can't be read so interrupts (whose handlers live in
+  // flash) are held off until the operation is complete
+  static const uint32_t save_region = PICO_FLASH_SIZE_BYTES - SAVE_REGION_SIZE;
 
-    // start the dma transfer of scanline data
-    //dma_scanline = 0;
-    //transmit_scanline();
+  const uint8_t *flash_data(uint32_t offset) {
+    return (const uint8_t *)(XIP_BASE + save_region + offset);
+  }
 
-    //wait_vsync();
+  void flash_erase_sector(uint32_t offset) {
+    uint32_t status = save_and_disable_interrupts();
+    flash_range_erase(save_region + offset, SAVE_SECTOR_SIZE);
+    restore_interrupts(status);
+  }
 
-    // if dma transfer already in process then skip
+  void flash_program_page(uint32_t offset, const uint8_t *data) {
+    uint32_t status = save_and_disable_interrupts();
+    flash_range_program(save_region + offset, data, SAVE_PAGE_SIZE);
+    restore_interrupts(status);
+  }
+
+  void flip() {
+    // if a transfer is already pending or in progress then skip, otherwise
+    // the vsync interrupt will start the transfer at the next vsync
     if(!is_flipping()) {
-      // much faster to copy the buffer then dma that in the background
- //     memcpy(dma_buffer, screen.data, screen.w * screen.h * 2);
+      if(skip_unchanged_frames) {
+        const buffer_t &fb = _screen.buffer;
+        dma_sniffer_enable(sniff_channel, DMA_SNIFF_CTRL_CALC_VALUE_CRC32R, true);
+        // reflected crc32 read back bit reversed and inverted, as crc32()
+        hw_set_bits(&dma_hw->sniff_ctrl, DMA_SNIFF_CTRL_OUT_REV_BITS | DMA_SNIFF_CTRL_OUT_INV_BITS);
+        dma_hw->sniff_data = 0xffffffff;
+        if(packed_screen) {
+          const packed_buffer_t &pb = *packed_screen;
+          dma_channel_transfer_from_buffer_now(sniff_channel, pb.data, packed_size(pb.w, pb.h) / 4);
+        }else{
+          dma_channel_transfer_from_buffer_now(sniff_channel, fb.data, fb.w * fb.h / 2);
+        }
+      }
 
-      uint32_t transfer_count = _fb.w * _fb.h / 2;
-      dma_channel_transfer_from_buffer_now(dma_channel, _fb.data, transfer_count);
+      flip_pending = true;
     }
+  }
 
-    // wait for screen transfer to complete before returning control
-    //while(dma_active) {
-    //}
+  void skip_unchanged(bool enabled) {
+    if(enabled && sniff_channel < 0) {
+      sniff_channel = dma_claim_unused_channel(true);
+      dma_channel_config config = dma_channel_get_default_config(sniff_channel);
+      channel_config_set_write_increment(&config, false);
+      channel_config_set_sniff_enable(&config, true);
+      dma_channel_configure(sniff_channel, &config, &sniff_sink, nullptr, 0, false);
+    }
+
+    // always send the first frame after a change of mode
+    while(is_flipping()) {
+      __wfe();
+    }
+    skip_unchanged_frames = enabled;
+    last_crc_valid = false;
   }
 
+  void screen_packed(const packed_buffer_t *b) {
+    while(is_flipping()) {
+      __wfe();
+    }
+
+    if(!b != !packed_screen) {
+      // let the end of the last frame drain out of the state machine
+      // before swapping its program
+      uint32_t stall = 1u << (PIO_FDEBUG_TXSTALL_LSB + screen_sm);
+      screen_pio->fdebug = stall;
+      while(!(screen_pio->fdebug & stall)) {
+        tight_loop_contents();
+      }
+
+      pio_sm_set_enabled(screen_pio, screen_sm, false);
+      screen_program_init(screen_pio, screen_sm, b ? screen_packed_offset : screen_offset, b);
+    }
+
+    packed_screen = b;
+    last_crc_valid = false;
+  }
+
+  bool packed_scanout() {
+    return packed_screen;
+  }
+
+  // drawing dma
+  //
+  // the rp2040 dma has no 2d mode so rectangles are sent as a list of control
+  // blocks, one per row, which a second channel writes into the data channel's
+  // registers each time it finishes a row. the list is allocated from the
+  // frame arena and ends with a null block that stops the chain.
+  //
+  // rows are moved a word at a time where the source and destination line up
+  // with any odd pixel at either end written by the cpu, otherwise a pixel at
+  // a time.
+  struct dma_block_t {
+    uint32_t ctrl, read, write, count;
+  };
+
+  int draw_channel = -1, draw_control_channel = -1;
+  uint32_t fill_word;
+  const dma_block_t *draw_blocks_end = nullptr;
+
+  static uint32_t draw_ctrl(bool fill, dma_channel_transfer_size size) {
+    dma_channel_config c = dma_channel_get_default_config(draw_channel);
+    channel_config_set_transfer_data_size(&c, size);
+    channel_config_set_read_increment(&c, !fill);
+    channel_config_set_write_increment(&c, true);
+    channel_config_set_chain_to(&c, draw_control_channel);
+    channel_config_set_irq_quiet(&c, true);
+    return channel_config_get_ctrl_value(&c);
+  }
+
+  static bool dma_rect(const pen_t *src, uint32_t src_stride, pen_t *dest, uint32_t dest_stride, uint32_t w, uint32_t h, pen_t p) {
+    if(draw_channel < 0) {
+      draw_channel = dma_claim_unused_channel(true);
+      draw_control_channel = dma_claim_unused_channel(true);
+
+      // four words per block into the data channel's alias 1 registers
+      // (ctrl, read, write, count and trigger) wrapping every 16 bytes
+      dma_channel_config c = dma_channel_get_default_config(draw_control_channel);
+      channel_config_set_read_increment(&c, true);
+      channel_config_set_write_increment(&c, true);
+      channel_config_set_ring(&c, true, 4);
+      dma_channel_configure(draw_control_channel, &c, &dma_hw->ch[draw_channel].al1_ctrl, nullptr, 4, false);
+    }
+
+    dma_wait();
+
+    // a zero count would end the chain early
+    if(!w || !h) return true;
+
+    // rows that run on into each other are one long row
+    if(w == dest_stride && (!src || w == src_stride)) {
+      w *= h;
+      h = 1;
+    }
+
+    dma_block_t *blocks = (dma_block_t *)frame_alloc((h + 1) * sizeof(dma_block_t));
+    if(!blocks) return false;
+
+    uint32_t ctrl_fill = draw_ctrl(true, DMA_SIZE_32);
+    uint32_t ctrl_copy = draw_ctrl(false, DMA_SIZE_32);
+    uint32_t ctrl_copy16 = draw_ctrl(false, DMA_SIZE_16);
+
+    fill_word = p | (p << 16);
+
+    dma_block_t *b = blocks;
+    for(uint32_t y = 0; y < h; y++) {
+      pen_t *d = dest + y * dest_stride;
+      const pen_t *s = src ? src + y * src_stride : nullptr;
+      uint32_t count = w;
+
+      if(s && ((uintptr_t(s) ^ uintptr_t(d)) & 0b10)) {
+        // source and destination can never be word aligned together
+        *b++ = {ctrl_copy16, uint32_t(uintptr_t(s)), uint32_t(uintptr_t(d)), count};
+        continue;
+      }
+
+      if(uintptr_t(d) & 0b10) {
+        *d++ = s ? *s++ : p;
+        count--;
+      }
+
+      if(count & 1) {
+        d[count - 1] = s ? s[count - 1] : p;
+      }
+
+      if(count >> 1) {
+        *b++ = {
+          s ? ctrl_copy : ctrl_fill,
+          uint32_t(s ? uintptr_t(s) : uintptr_t(&fill_word)), uint32_t(uintptr_t(d)), count >> 1
+        };
+      }
+    }
+
+    if(b == blocks) return true;
+
+    *b++ = {0, 0, 0, 0};
+    draw_blocks_end = b;
+    dma_channel_set_read_addr(draw_control_channel, blocks, true);
+    return true;
+  }
+
+  bool dma_fill(pen_t *dest, uint32_t stride, uint32_t w, uint32_t h, pen_t p) {
+    return dma_rect(nullptr, 0, dest, stride, w, h, p);
+  }
+
+  bool dma_copy(const pen_t *src, uint32_t src_stride, pen_t *dest, uint32_t dest_stride, uint32_t w, uint32_t h) {
+    return dma_rect(src, src_stride, dest, dest_stride, w, h, 0);
+  }
+
+  bool dma_busy() {
+    if(!draw_blocks_end) return false;
+
+    // finished once the control channel has read the null block and the
+    // last row has drained
+    if(dma_hw->ch[draw_control_channel].read_addr == uintptr_t(draw_blocks_end) &&
+       !dma_channel_is_busy(draw_control_channel) && !dma_channel_is_busy(draw_channel)) {
+      draw_blocks_end = nullptr;
+      return false;
+    }
+
+    return true;
+  }
+
+  void dma_wait() {
+    while(dma_busy()) {
+      tight_loop_contents();
+    }
+  }
+
+  // gamma of 2.8 from 8-bit brightness to 16-bit pwm level, worked out by
+  // the compiler so it costs a lookup rather than a soft float pow(). x^2.8
+  // is x^3 over the fifth root of x, which newton's method finds.
+  struct gamma_table_t {
+    uint16_t v[256];
+    constexpr gamma_table_t() : v() {
+      for(int i = 0; i < 256; i++) {
+        double x = i / 255.0, r = 1.0;
+        for(int n = 0; i && n < 64; n++) {
+          r -= (r * r * r * r * r - x) / (5.0 * r * r * r * r);
+        }
+        v[i] = uint16_t(i ? x * x * x / r * 65535.0 + 0.5 : 0);
+      }
+    }
+  };
+
+  constexpr gamma_table_t GAMMA;
+
   uint16_t gamma_correct(uint8_t value) {
-    float gamma = 2.8;
-    return (uint16_t)(pow((float)(value) / 255.0f, gamma) * 65535.0f + 0.5f);
+    return GAMMA.v[value];
+  }
+
+  // fades and pulses are stepped from a repeating timer which only runs
+  // while one is in progress. brightness is kept in 8.16 fixed point and
+  // the gamma table interpolated so slow fades at the dim end don't step.
+  constexpr int32_t FADE_TICK_MS = 2;
+
+  struct fade_t {
+    uint8_t pin;
+    int32_t level;    // 8.16 brightness
+    int32_t step;     // per tick
+    uint32_t ticks;   // left in the fade
+    int32_t peak;     // 8.16 brightness at the top of a pulse
+    uint32_t period;  // ticks per pulse, 0 if not pulsing
+    uint32_t phase;
+  };
+
+  fade_t fades[4] = {{BACKLIGHT}, {RED}, {GREEN}, {BLUE}};
+  enum {FADE_BACKLIGHT, FADE_RED, FADE_GREEN, FADE_BLUE};
+
+  repeating_timer_t fade_timer;
+  volatile bool fade_running = false;
+
+  void fade_apply(const fade_t &f) {
+    uint32_t i = f.level >> 16, frac = f.level & 0xffff;
+    uint32_t level = GAMMA.v[i];
+    if(frac && i < 255) {
+      level += ((GAMMA.v[i + 1] - level) * frac) >> 16;
+    }
+    pwm_set_gpio_level(f.pin, level);
+  }
+
+  bool fade_tick(repeating_timer_t *rt) {
+    bool active = false;
+    for(fade_t &f : fades) {
+      if(f.period) {
+        // triangle wave from off up to the peak and back
+        f.phase = (f.phase + 1) % f.period;
+        uint32_t half = f.period / 2;
+        uint32_t t = f.phase < half ? f.phase : f.period - f.phase;
+        f.level = int32_t(int64_t(f.peak) * t / std::max<uint32_t>(half, 1));
+      }else if(f.ticks) {
+        f.level += f.step;
+        f.ticks--;
+      }else{
+        continue;
+      }
+
+      fade_apply(f);
+      active = true;
+    }
+
+    fade_running = active;
+    return active;
+  }
+
+  // interrupts must be disabled, the timer can't then stop between
+  // checking it and setting up the next fade
+  void fade_start(fade_t &f, uint8_t target, uint32_t ms) {
+    int32_t to = int32_t(target) << 16;
+    f.period = 0;
+    f.ticks = ms / FADE_TICK_MS;
+    if(!f.ticks) {
+      f.level = to;
+      fade_apply(f);
+      return;
+    }
+
+    // the last tick lands exactly on the target
+    f.step = (to - f.level) / int32_t(f.ticks);
+    f.level = to - f.step * int32_t(f.ticks);
+
+    if(!fade_running) {
+      fade_running = true;
+      add_repeating_timer_ms(-FADE_TICK_MS, fade_tick, nullptr, &fade_timer);
+    }
+  }
+
+  void fade_pulse(fade_t &f, uint8_t peak, uint32_t period_ms) {
+    f.ticks = 0;
+    f.peak = int32_t(peak) << 16;
+    f.period = std::max<uint32_t>(period_ms / FADE_TICK_MS, 2);
+    f.phase = 0;
+
+    if(!fade_running) {
+      fade_running = true;
+      add_repeating_timer_ms(-FADE_TICK_MS, fade_tick, nullptr, &fade_timer);
+    }
   }
 
   void backlight(uint8_t brightness) {
-    pwm_set_gpio_level(BACKLIGHT, gamma_correct(brightness));
+    backlight_fade(brightness, 0);
+  }
+
+  void backlight_fade(uint8_t brightness, uint32_t ms) {
+    uint32_t status = save_and_disable_interrupts();
+    fade_start(fades[FADE_BACKLIGHT], brightness, ms);
+    restore_interrupts(status);
   }
 
   void led(uint8_t r, uint8_t g, uint8_t b) {
-    pwm_set_gpio_level(RED,   gamma_correct(r));
-    pwm_set_gpio_level(GREEN, gamma_correct(g));
-    pwm_set_gpio_level(BLUE,  gamma_correct(b));
+    led_fade(r, g, b, 0);
+  }
+
+  void led_fade(uint8_t r, uint8_t g, uint8_t b, uint32_t ms) {
+    uint32_t status = save_and_disable_interrupts();
+    fade_start(fades[FADE_RED],   r, ms);
+    fade_start(fades[FADE_GREEN], g, ms);
+    fade_start(fades[FADE_BLUE],  b, ms);
+    restore_interrupts(status);
+  }
+
+  void led_pulse(uint8_t r, uint8_t g, uint8_t b, uint32_t period_ms) {
+    uint32_t status = save_and_disable_interrupts();
+    fade_pulse(fades[FADE_RED],   r, period_ms);
+    fade_pulse(fades[FADE_GREEN], g, period_ms);
+    fade_pulse(fades[FADE_BLUE],  b, period_ms);
+    restore_interrupts(status);
+  }
+
+  bool is_fading() {
+    return fade_running;
+  }
+
+  // the screen pio and the pwm counters run from the system clock so when it
+  // changes their dividers are adjusted to keep them at the same rate, the
+  // screen pio at no more than 125mhz and the pwm counters at 125mhz. the
+  // pio divider is rounded up to a whole number, a fractional one spaces
+  // pio cycles by whole system clocks which can make a single clock phase
+  // shorter than the st7789 allows. at 200mhz that slows a frame to 13.8ms.
+  void retune_clocks(uint32_t khz) {
+    uint32_t pio_div = (khz + 124999) / 125000;
+    pio_sm_set_clkdiv_int_frac(screen_pio, screen_sm, pio_div, 0);
+    screen_clkdiv = pio_div << 8;
+
+    uint32_t pwm_div = 16 * khz / 125000;  // 8.4 fixed point
+    for(uint gpio : {BACKLIGHT, RED, GREEN, BLUE}) {
+      pwm_set_clkdiv_int_frac(pwm_gpio_to_slice_num(gpio), pwm_div >> 4, pwm_div & 0xf);
+    }
+
+    // spi (used for screen commands) runs from clk_peri which follows clk_sys
+    spi_set_baudrate(spi0, 8000000);
+  }
+
+  void set_clock(uint32_t khz) {
+    set_sys_clock_khz(khz, true);
+    retune_clocks(khz);
   }
 
   void init_screen() {
@@ -327,11 +751,12 @@ static inline void screen_program_init(PIO pio, uint sm, uint offset) {
     // enable vsync interrupt to synchronise screen updates
     gpio_init(pin::VSYNC);
     gpio_set_dir(pin::VSYNC, GPIO_IN);
-    //gpio_set_irq_enabled_with_callback(pin::VSYNC, GPIO_IRQ_EDGE_RISE, true, &on_vsync);
+    gpio_set_irq_enabled_with_callback(pin::VSYNC, GPIO_IRQ_EDGE_RISE, true, &on_vsync);
 
     // setup the pixel doubling pio program
-    uint offset = pio_add_program(screen_pio, &screen_program);
-    screen_program_init(screen_pio, screen_sm, offset);
+    screen_offset = pio_add_program(screen_pio, &screen_program);
+    screen_packed_offset = pio_add_program(screen_pio, &screen_packed_program);
+    screen_program_init(screen_pio, screen_sm, screen_offset, false);
 
     // initialise dma channel for transmitting pixel data to screen
     // via the pixel doubling pio - initially we configure it with no
@@ -344,7 +769,6 @@ static inline void screen_program_init(PIO pio, uint sm, uint offset) {
 
     dma_channel_configure(dma_channel, &config, &screen_pio->txf[screen_sm], nullptr, 0, false);
     dma_channel_set_irq0_enabled(dma_channel, true);
-    irq_set_enabled(pio_get_dreq(screen_pio, screen_sm, true), true);
     irq_set_exclusive_handler(DMA_IRQ_0, dma_complete);
     irq_set_enabled(DMA_IRQ_0, true);
   }
@@ -382,6 +806,7 @@ void init_hardware() {
 
 
     init_screen();
+    retune_clocks(250000);
     backlight(255);
 
 
@@ -0,0 +1,170 @@
+#include <cstdint>
+#include <cstring>
+
+#include "lz.hpp"
+
+namespace picosystem {
+
+  namespace {
+    constexpr uint32_t HEADER_SIZE = 12;
+    constexpr uint32_t MIN_MATCH = 4;
+
+    // assets are only byte aligned so header fields are read a byte at a time
+    uint32_t read32(const uint8_t *p) {
+      return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+    }
+
+    // adds any extension bytes to a nibble length of 15
+    uint32_t read_length(const uint8_t *&p, uint32_t length) {
+      if(length == 15) {
+        uint8_t b;
+        do {
+          b = *p++;
+          length += b;
+        } while(b == 255);
+      }
+
+      return length;
+    }
+  }
+
+  bool lz_header(const uint8_t *data, lz_header_t &header) {
+    if(memcmp(data, "PSLZ", 4) != 0) return false;
+
+    header.size = read32(data + 4);
+    header.window_bits = data[8];
+    return header.window_bits <= 16;
+  }
+
+  uint32_t lz_decompress(const uint8_t *data, void *dest, uint32_t max) {
+    lz_header_t header;
+    if(!lz_header(data, header) || header.size > max) return 0;
+
+    const uint8_t *p = data + HEADER_SIZE;
+    uint8_t *o = (uint8_t *)dest, *end = o + header.size;
+
+    while(true) {
+      uint8_t token = *p++;
+
+      uint32_t literals = read_length(p, token >> 4);
+      if(literals > uint32_t(end - o)) return 0;
+      memcpy(o, p, literals);
+      o += literals;
+      p += literals;
+
+      if(o == end) break;
+
+      uint32_t offset = p[0] | (p[1] << 8);
+      p += 2;
+      uint32_t match = read_length(p, token & 0xf) + MIN_MATCH;
+      if(!offset || offset > uint32_t(o - (uint8_t *)dest) || match > uint32_t(end - o)) return 0;
+
+      // matches may overlap their own output so can't use memcpy, though
+      // distant matches can be copied a word at a time
+      const uint8_t *m = o - offset;
+      if(offset >= 4) {
+        while(match >= 4) {
+          memcpy(o, m, 4);
+          o += 4;
+          m += 4;
+          match -= 4;
+        }
+      }
+      while(match--) {
+        *o++ = *m++;
+      }
+    }
+
+    return header.size;
+  }
+
+  bool lz_decompress(const uint8_t *data, buffer_t &dest) {
+    uint32_t size = dest.w * dest.h * sizeof(pen_t);
+    lz_header_t header;
+    return lz_header(data, header) && header.size == size &&
+           lz_decompress(data, dest.data, size) == size;
+  }
+
+  bool lz_open(lz_stream_t &s, const uint8_t *data, void *window, uint32_t window_size) {
+    lz_header_t header;
+    if(!lz_header(data, header)) return false;
+
+    if(window_size >= header.size) {
+      // the window is the destination, no need to wrap
+      s.window_mask = 0xffffffff;
+    }else if(window_size >= (1U << header.window_bits) && !(window_size & (window_size - 1))) {
+      s.window_mask = window_size - 1;
+    }else{
+      return false;
+    }
+
+    s.src = data + HEADER_SIZE;
+    s.remaining = header.size;
+    s.match = 0;
+    s.offset = 0;
+    s.window = (uint8_t *)window;
+    s.position = 0;
+
+    // the first token is read lazily by lz_read()
+    s.literals = 0xffffffff;
+    return true;
+  }
+
+  uint32_t lz_read(lz_stream_t &s, void *dest, uint32_t count) {
+    uint8_t *o = (uint8_t *)dest;
+    uint32_t produced = 0;
+    count = std::min(count, s.remaining);
+
+    while(produced < count) {
+      if(s.literals == 0xffffffff) {
+        // start of a new sequence
+        uint8_t token = *s.src++;
+        s.literals = read_length(s.src, token >> 4);
+        s.match = token & 0xf;
+      }
+
+      if(s.literals) {
+        uint32_t n = std::min(s.literals, count - produced);
+        for(uint32_t i = 0; i < n; i++) {
+          s.window[(s.position + i) & s.window_mask] = s.src[i];
+        }
+        if(o) {
+          memcpy(o, s.src, n);
+          o += n;
+        }
+
+        s.src += n;
+        s.literals -= n;
+        s.position += n;
+        produced += n;
+        continue;
+      }
+
+      if(s.offset == 0) {
+        // literals done, read the match that follows them
+        s.offset = s.src[0] | (s.src[1] << 8);
+        s.src += 2;
+        s.match = read_length(s.src, s.match) + MIN_MATCH;
+      }
+
+      uint32_t n = std::min(s.match, count - produced);
+      for(uint32_t i = 0; i < n; i++) {
+        uint8_t b = s.window[(s.position - s.offset) & s.window_mask];
+        s.window[s.position & s.window_mask] = b;
+        s.position++;
+        if(o) *o++ = b;
+      }
+
+      s.match -= n;
+      produced += n;
+      if(!s.match) {
+        s.offset = 0;
+        s.literals = 0xffffffff;
+      }
+    }
+
+    s.remaining -= produced;
+    return produced;
+  }
+
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // compressed assets
+  //
+  // assets are compressed offline with tools/lz.py into a small container:
+  //
+  //   "PSLZ", uint32_t size, uint8_t window_bits, 3 bytes reserved
+  //
+  // followed by lz4-style sequences. each sequence is a token byte holding
+  // the literal count (high nibble) and match length - 4 (low nibble), with
+  // a nibble of 15 continued by extra bytes that are added until one is less
+  // than 255. then come the literals and a little-endian 16-bit match
+  // offset. the final sequence has literals only.
+  //
+  // decoding is byte copies with no entropy stage so it runs at close to
+  // memcpy speed straight out of flash.
+  struct lz_header_t {
+    uint32_t size;         // decompressed size
+    uint8_t window_bits;   // matches reach back at most 1 << window_bits
+  };
+
+  // false if data doesn't start with a valid header
+  bool lz_header(const uint8_t *data, lz_header_t &header);
+
+  // decompresses a whole asset, returns its size or 0 if it isn't valid or
+  // won't fit in max bytes
+  uint32_t lz_decompress(const uint8_t *data, void *dest, uint32_t max);
+
+  // decompresses into a buffer, which must be exactly the right size
+  bool lz_decompress(const uint8_t *data, buffer_t &dest);
+
+  // streaming decompression
+  //
+  // the stream keeps its history in a window supplied by the caller, either
+  // a ring of at least 1 << window_bits bytes (a power of two) so an asset
+  // can be decoded a chunk at a time into a small buffer, or the final
+  // destination if it holds the whole asset. in the second case pass
+  // nullptr to lz_read() to decode in place, which spreads a large load
+  // over several frames by reading a budget of bytes each update.
+  struct lz_stream_t {
+    const uint8_t *src;     // next compressed byte
+    uint32_t remaining;     // decompressed bytes still to come
+    uint32_t literals;      // literals left in the current sequence
+    uint32_t match;         // match bytes left in the current sequence
+    uint32_t offset;        // distance back of the current match
+    uint8_t *window;
+    uint32_t window_mask;
+    uint32_t position;      // decompressed bytes so far
+  };
+
+  bool lz_open(lz_stream_t &s, const uint8_t *data, void *window, uint32_t window_size);
+
+  // decompresses up to count bytes into dest (and the window), returns the
+  // number of bytes produced which is less than count only at the end
+  uint32_t lz_read(lz_stream_t &s, void *dest, uint32_t count);
+
+  inline bool lz_done(const lz_stream_t &s) { return s.remaining == 0; }
+
+}
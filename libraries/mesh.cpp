@@ -0,0 +1,445 @@
+#include <cstdint>
+#include <algorithm>
+
+#include "mesh.hpp"
+
+namespace picosystem {
+
+  uint16_t *_depth = nullptr;
+
+  namespace {
+    // a quarter turn of sine in 256 steps, built by the compiler
+    constexpr double QUARTER_TURN = 1.5707963267948966;
+
+    constexpr double taylor_sin(double x) {
+      double term = x, sum = x;
+      for(int i = 1; i < 10; i++) {
+        term *= -x * x / ((2 * i) * (2 * i + 1));
+        sum += term;
+      }
+      return sum;
+    }
+
+    struct sine_table_t {
+      fixed_t v[257];
+      constexpr sine_table_t() : v() {
+        for(int i = 0; i <= 256; i++) {
+          v[i] = fixed_t(taylor_sin(QUARTER_TURN * i / 256) * FIXED_ONE + 0.5);
+        }
+      }
+    };
+
+    constexpr sine_table_t SINE;
+
+    // spans are built up in a line buffer this many pixels at a time
+    constexpr int32_t SPAN_CHUNK = 64;
+
+    // projected coordinates are kept within this many pixels of the screen
+    constexpr int64_t GUARD_BAND = 1024;
+
+    // attribute slots interpolated across a triangle
+    enum {DEPTH, RED, GREEN, BLUE, U, V, ATTRIBUTES};
+
+    struct flat_shader_t {
+      static constexpr bool constant = true;
+      pen_t p;
+      pen_t pen() const { return p; }
+      void step() {}
+    };
+
+    struct gouraud_shader_t {
+      static constexpr bool constant = false;
+      fixed_t r, g, b, dr, dg, db;
+      pen_t alpha;
+      pen_t pen() const {
+        return  std::clamp<int32_t>(r >> 16, 0, 15)       | alpha |
+               (std::clamp<int32_t>(b >> 16, 0, 15) << 8) |
+               (std::clamp<int32_t>(g >> 16, 0, 15) << 12);
+      }
+      void step() { r += dr; g += dg; b += db; }
+    };
+
+    struct texture_shader_t {
+      static constexpr bool constant = false;
+      const buffer_t *t;
+      fixed_t u, v, du, dv;
+      pen_t pen() const {
+        return t->data[((v >> 16) & (t->h - 1)) * t->w + ((u >> 16) & (t->w - 1))];
+      }
+      void step() { u += du; v += dv; }
+    };
+
+    // draws count pixels of a span, with a depth buffer the pixels that
+    // pass the test are gathered into runs for the blend function
+    template<typename S>
+    void draw_span(S s, pen_t *dest, uint16_t *depth, int32_t count, fixed_t z, fixed_t dz) {
+      pen_t line[SPAN_CHUNK];
+      pen_t *start = dest;
+      int32_t n = 0;
+
+      auto flush = [&]() {
+        if(!n) return;
+        if(S::constant) {
+          pen_t p = s.pen();
+          _bf(&p, 0, start, n);
+        }else{
+          _bf(line, 1, start, n);
+        }
+        n = 0;
+      };
+
+      if(S::constant && !depth) {
+        n = count;
+        flush();
+        return;
+      }
+
+      for(int32_t i = 0; i < count; i++) {
+        bool visible = true;
+        if(depth) {
+          uint16_t d = std::clamp<int32_t>(z, 0, 0xffff);
+          visible = d > depth[i];
+          if(visible) depth[i] = d;
+          z += dz;
+        }
+
+        if(visible) {
+          if(!n) start = dest + i;
+          if(!S::constant) line[n] = s.pen();
+          n++;
+          if(n == SPAN_CHUNK) flush();
+        }else{
+          flush();
+        }
+
+        s.step();
+      }
+
+      flush();
+    }
+
+    struct clip_vertex_t {
+      vec3_t p;
+      fixed_t r, g, b, u, v;
+    };
+
+    fixed_t lerp(fixed_t a, fixed_t b, fixed_t t) {
+      return a + fixed_t(((int64_t(b) - a) * t) >> 16);
+    }
+
+    clip_vertex_t lerp(const clip_vertex_t &a, const clip_vertex_t &b, fixed_t t) {
+      return {
+        {lerp(a.p.x, b.p.x, t), lerp(a.p.y, b.p.y, t), lerp(a.p.z, b.p.z, t)},
+        lerp(a.r, b.r, t), lerp(a.g, b.g, t), lerp(a.b, b.b, t),
+        lerp(a.u, b.u, t), lerp(a.v, b.v, t)
+      };
+    }
+
+    // signed distance of a view space point from each clip plane, the near
+    // plane and then the four sides of the guard band
+    int64_t plane_distance(const vec3_t &p, uint32_t plane, fixed_t near, fixed_t guard) {
+      int64_t gz = (int64_t(p.z) * guard) >> 16;
+      switch(plane) {
+        case 0:  return int64_t(p.z) - near;
+        case 1:  return gz - p.x;
+        case 2:  return gz + p.x;
+        case 3:  return gz - p.y;
+        default: return gz + p.y;
+      }
+    }
+
+    // clips a polygon against all five planes, returns the vertex count.
+    // each plane adds at most one vertex so buffers need room for eight.
+    uint32_t clip_polygon(clip_vertex_t *poly, uint32_t count, fixed_t near, fixed_t guard) {
+      clip_vertex_t out[8];
+      for(uint32_t plane = 0; plane < 5 && count >= 3; plane++) {
+        uint32_t n = 0;
+        for(uint32_t i = 0; i < count; i++) {
+          const clip_vertex_t &a = poly[i], &b = poly[(i + 1) % count];
+          int64_t da = plane_distance(a.p, plane, near, guard);
+          int64_t db = plane_distance(b.p, plane, near, guard);
+          if(da >= 0) out[n++] = a;
+          if((da >= 0) != (db >= 0)) {
+            out[n++] = lerp(a, b, fixed_t(da * 65536 / (da - db)));
+          }
+        }
+
+        std::copy(out, out + n, poly);
+        count = n;
+      }
+
+      return count < 3 ? 0 : count;
+    }
+
+    struct sort_key_t {
+      int32_t z;
+      uint32_t triangle;
+    };
+  }
+
+  fixed_t fixed_sin(uint16_t angle) {
+    // the second and fourth quadrants read the table backwards
+    uint32_t quadrant = angle >> 14, q = angle & 0x3fff;
+    if(quadrant & 1) q = 0x4000 - q;
+
+    uint32_t i = q >> 6, f = q & 0x3f;
+    fixed_t v = SINE.v[i];
+    if(f) {
+      v += ((SINE.v[i + 1] - v) * int32_t(f)) >> 6;
+    }
+
+    return quadrant & 2 ? -v : v;
+  }
+
+  fixed_t fixed_cos(uint16_t angle) {
+    return fixed_sin(angle + 0x4000);
+  }
+
+  mat_t identity() {
+    return scaling(FIXED_ONE, FIXED_ONE, FIXED_ONE);
+  }
+
+  mat_t translation(fixed_t x, fixed_t y, fixed_t z) {
+    mat_t m = identity();
+    m.m[0][3] = x;
+    m.m[1][3] = y;
+    m.m[2][3] = z;
+    return m;
+  }
+
+  mat_t scaling(fixed_t x, fixed_t y, fixed_t z) {
+    return {{{x, 0, 0, 0}, {0, y, 0, 0}, {0, 0, z, 0}}};
+  }
+
+  mat_t rotation_x(uint16_t angle) {
+    fixed_t s = fixed_sin(angle), c = fixed_cos(angle);
+    return {{{FIXED_ONE, 0, 0, 0}, {0, c, -s, 0}, {0, s, c, 0}}};
+  }
+
+  mat_t rotation_y(uint16_t angle) {
+    fixed_t s = fixed_sin(angle), c = fixed_cos(angle);
+    return {{{c, 0, s, 0}, {0, FIXED_ONE, 0, 0}, {-s, 0, c, 0}}};
+  }
+
+  mat_t rotation_z(uint16_t angle) {
+    fixed_t s = fixed_sin(angle), c = fixed_cos(angle);
+    return {{{c, -s, 0, 0}, {s, c, 0, 0}, {0, 0, FIXED_ONE, 0}}};
+  }
+
+  mat_t operator*(const mat_t &a, const mat_t &b) {
+    mat_t r;
+    for(uint32_t i = 0; i < 3; i++) {
+      for(uint32_t j = 0; j < 4; j++) {
+        int64_t v = int64_t(a.m[i][0]) * b.m[0][j] +
+                    int64_t(a.m[i][1]) * b.m[1][j] +
+                    int64_t(a.m[i][2]) * b.m[2][j];
+        r.m[i][j] = fixed_t(v >> 16) + (j == 3 ? a.m[i][3] : 0);
+      }
+    }
+    return r;
+  }
+
+  vec3_t operator*(const mat_t &m, const vec3_t &v) {
+    fixed_t r[3];
+    for(uint32_t i = 0; i < 3; i++) {
+      r[i] = fixed_t((int64_t(m.m[i][0]) * v.x +
+                      int64_t(m.m[i][1]) * v.y +
+                      int64_t(m.m[i][2]) * v.z) >> 16) + m.m[i][3];
+    }
+    return {r[0], r[1], r[2]};
+  }
+
+  void triangle(const vertex_t &a, const vertex_t &b, const vertex_t &c,
+                shading_t shading, const buffer_t *texture) {
+    if(shading == TEXTURED && !texture) return;
+
+    // sort by y, positions go to 28.4 for the edge and gradient setup
+    const vertex_t *v[3] = {&a, &b, &c};
+    if(v[1]->y < v[0]->y) std::swap(v[0], v[1]);
+    if(v[2]->y < v[1]->y) std::swap(v[1], v[2]);
+    if(v[1]->y < v[0]->y) std::swap(v[0], v[1]);
+
+    int32_t x[3], y[3];
+    fixed_t attr[3][ATTRIBUTES];
+    for(uint32_t i = 0; i < 3; i++) {
+      x[i] = (v[i]->x + 0x800) >> 12;
+      y[i] = (v[i]->y + 0x800) >> 12;
+
+      pen_t p = v[i]->pen;
+      attr[i][DEPTH] = v[i]->depth;
+      attr[i][RED]   = ((p & 0xf) << 16) + 0x8000;
+      attr[i][GREEN] = ((p >> 12) << 16) + 0x8000;
+      attr[i][BLUE]  = (((p >> 8) & 0xf) << 16) + 0x8000;
+      attr[i][U]     = v[i]->u;
+      attr[i][V]     = v[i]->v;
+    }
+
+    int64_t x1 = x[1] - x[0], y1 = y[1] - y[0];
+    int64_t x2 = x[2] - x[0], y2 = y[2] - y[0];
+    int64_t area = x1 * y2 - x2 * y1;
+    if(!area) return;
+
+    // per pixel gradients of each attribute over the triangle's plane
+    fixed_t dx[ATTRIBUTES], dy[ATTRIBUTES];
+    for(uint32_t i = 0; i < ATTRIBUTES; i++) {
+      int64_t a1 = int64_t(attr[1][i]) - attr[0][i];
+      int64_t a2 = int64_t(attr[2][i]) - attr[0][i];
+      dx[i] = fixed_t((a1 * y2 - a2 * y1) * 16 / area);
+      dy[i] = fixed_t((a2 * x1 - a1 * x2) * 16 / area);
+    }
+
+    // rows whose centres fall inside the triangle, limited to the clip
+    // rectangle and the target
+    int32_t y0 = std::max<int32_t>(std::max<int32_t>(_cy, 0), (y[0] + 7) >> 4);
+    int32_t y3 = std::min<int32_t>(std::min<int32_t>(_cy + _ch, _fb.h), (y[2] + 7) >> 4);
+    int32_t cx0 = std::max<int32_t>(_cx, 0);
+    int32_t cx1 = std::min<int32_t>(_cx + _cw, _fb.w);
+
+    // edge slopes in 28.4 per 28.4 with 16 bits of fraction
+    auto slope = [&](uint32_t i, uint32_t j) -> int64_t {
+      return y[j] == y[i] ? 0 : (int64_t(x[j]) - x[i]) * 65536 / (y[j] - y[i]);
+    };
+    int64_t long_edge = slope(0, 2), top_edge = slope(0, 1), bottom_edge = slope(1, 2);
+
+    for(int32_t row = y0; row < y3; row++) {
+      int32_t yc = row * 16 + 8;
+
+      int32_t xa = x[0] + int32_t(((yc - y[0]) * long_edge) >> 16);
+      int32_t xb = yc < y[1] ? x[0] + int32_t(((yc - y[0]) * top_edge) >> 16)
+                             : x[1] + int32_t(((yc - y[1]) * bottom_edge) >> 16);
+      if(xb < xa) std::swap(xa, xb);
+
+      int32_t sx = std::max<int32_t>(cx0, (xa + 7) >> 4);
+      int32_t ex = std::min<int32_t>(cx1, (xb + 7) >> 4);
+      int32_t count = ex - sx;
+      if(count <= 0) continue;
+
+      // attributes at the centre of the first pixel
+      int64_t ox = sx * 16 + 8 - x[0], oy = yc - y[0];
+      auto start = [&](uint32_t i) {
+        return attr[0][i] + fixed_t((ox * dx[i] + oy * dy[i]) / 16);
+      };
+
+      pen_t *dest = _fb.data + offset(sx, row);
+      uint16_t *depth = _depth ? _depth + offset(sx, row) : nullptr;
+      fixed_t z = depth ? start(DEPTH) : 0;
+
+      if(shading == FLAT) {
+        draw_span(flat_shader_t{a.pen}, dest, depth, count, z, dx[DEPTH]);
+      }else if(shading == GOURAUD) {
+        gouraud_shader_t s{start(RED), start(GREEN), start(BLUE),
+                           dx[RED], dx[GREEN], dx[BLUE], pen_t(a.pen & 0xf0)};
+        draw_span(s, dest, depth, count, z, dx[DEPTH]);
+      }else{
+        texture_shader_t s{texture, start(U), start(V), dx[U], dx[V]};
+        draw_span(s, dest, depth, count, z, dx[DEPTH]);
+      }
+    }
+  }
+
+  uint32_t draw_mesh(const mesh_t &mesh, const mat_t &model, const camera_t &camera,
+                     shading_t shading, bool sort, bool double_sided) {
+    if(shading == TEXTURED && (!mesh.texture || !mesh.uvs)) return 0;
+    if(camera.near <= 0 || camera.focal <= 0) return 0;
+
+    // every vertex into view space once
+    vec3_t *view = frame_array<vec3_t>(mesh.vertex_count);
+    if(!view) return 0;
+
+    mat_t mv = camera.view * model;
+    for(uint32_t i = 0; i < mesh.vertex_count; i++) {
+      view[i] = mv * mesh.vertices[i];
+    }
+
+    fixed_t guard = fixed_t((GUARD_BAND << 32) / camera.focal);
+    fixed_t cx = fixed_t(_fb.w) << 15, cy = fixed_t(_fb.h) << 15;
+
+    auto draw = [&](uint32_t t) -> bool {
+      const uint16_t *index = mesh.indices + t * 3;
+
+      clip_vertex_t poly[8];
+      for(uint32_t i = 0; i < 3; i++) {
+        clip_vertex_t &c = poly[i];
+        c = {view[index[i]], 0, 0, 0, 0, 0};
+
+        if(shading == GOURAUD) {
+          pen_t p = mesh.pens ? mesh.pens[index[i]] : _pen;
+          c.r = (p & 0xf) << 16;
+          c.g = (p >> 12) << 16;
+          c.b = ((p >> 8) & 0xf) << 16;
+        }
+
+        if(shading == TEXTURED) {
+          c.u = mesh.uvs[index[i] * 2];
+          c.v = mesh.uvs[index[i] * 2 + 1];
+        }
+      }
+
+      uint32_t count = clip_polygon(poly, 3, camera.near, guard);
+      if(!count) return false;
+
+      pen_t flat = shading == FLAT && mesh.pens ? mesh.pens[t] : _pen;
+      vertex_t out[8];
+      for(uint32_t i = 0; i < count; i++) {
+        const clip_vertex_t &c = poly[i];
+        vertex_t &o = out[i];
+        o.x = cx + fixed_t(int64_t(c.p.x) * camera.focal / c.p.z);
+        o.y = cy - fixed_t(int64_t(c.p.y) * camera.focal / c.p.z);
+        o.depth = fixed_t((int64_t(camera.near) << 16) / c.p.z);
+        o.u = c.u;
+        o.v = c.v;
+        o.pen = shading == GOURAUD
+          ? pen_t(((c.r + 0x8000) >> 16) | 0xf0 | (((c.b + 0x8000) >> 16) << 8) | (((c.g + 0x8000) >> 16) << 12))
+          : flat;
+      }
+
+      // winding on screen, clockwise (positive with y down) faces us
+      if(!double_sided) {
+        int64_t area = 0;
+        for(uint32_t i = 0; i < count; i++) {
+          const vertex_t &p = out[i], &q = out[(i + 1) % count];
+          area += (int64_t(p.x >> 8) * (q.y >> 8)) - (int64_t(q.x >> 8) * (p.y >> 8));
+        }
+        if(area <= 0) return false;
+      }
+
+      for(uint32_t i = 1; i + 1 < count; i++) {
+        triangle(out[0], out[i], out[i + 1], shading, mesh.texture);
+      }
+      return true;
+    };
+
+    uint32_t drawn = 0;
+    sort_key_t *keys = sort && !_depth ? frame_array<sort_key_t>(mesh.triangle_count) : nullptr;
+    if(keys) {
+      for(uint32_t t = 0; t < mesh.triangle_count; t++) {
+        const uint16_t *index = mesh.indices + t * 3;
+        keys[t] = {view[index[0]].z / 4 + view[index[1]].z / 4 + view[index[2]].z / 4, t};
+      }
+
+      std::sort(keys, keys + mesh.triangle_count,
+        [](const sort_key_t &a, const sort_key_t &b) { return a.z > b.z; });
+
+      for(uint32_t i = 0; i < mesh.triangle_count; i++) {
+        drawn += draw(keys[i].triangle);
+      }
+    }else{
+      for(uint32_t t = 0; t < mesh.triangle_count; t++) {
+        drawn += draw(t);
+      }
+    }
+
+    return drawn;
+  }
+
+  void depth_buffer(uint16_t *depth) {
+    _depth = depth;
+  }
+
+  void clear_depth() {
+    if(_depth) {
+      std::fill(_depth, _depth + _fb.w * _fb.h, 0);
+    }
+  }
+
+}
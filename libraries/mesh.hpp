@@ -0,0 +1,105 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // 3d
+  //
+  // everything is 16.16 fixed point. models are transformed into view space
+  // (x right, y up, z into the screen) by an affine matrix, clipped against
+  // the near plane and a guard band around the screen so projected
+  // coordinates stay small, then rasterised a span at a time into the
+  // current target through the blend function. spans are also clipped to
+  // the clip rectangle.
+  //
+  // hidden surfaces are removed either with a 16-bit depth buffer (see
+  // depth_buffer()) or by drawing triangles back to front.
+
+  constexpr fixed_t fixed_mul(fixed_t a, fixed_t b) {
+    return fixed_t((int64_t(a) * b) >> 16);
+  }
+
+  // angles are in 1/65536ths of a turn
+  fixed_t fixed_sin(uint16_t angle);
+  fixed_t fixed_cos(uint16_t angle);
+
+  struct vec3_t {
+    fixed_t x, y, z;
+  };
+
+  // rows are the x, y, and z outputs, the last column is the translation
+  struct mat_t {
+    fixed_t m[3][4];
+  };
+
+  mat_t identity();
+  mat_t translation(fixed_t x, fixed_t y, fixed_t z);
+  mat_t scaling(fixed_t x, fixed_t y, fixed_t z);
+  mat_t rotation_x(uint16_t angle);
+  mat_t rotation_y(uint16_t angle);
+  mat_t rotation_z(uint16_t angle);
+  mat_t operator*(const mat_t &a, const mat_t &b);
+  vec3_t operator*(const mat_t &m, const vec3_t &v);
+
+  enum shading_t : uint8_t {
+    FLAT,     // one pen per triangle
+    GOURAUD,  // pens per vertex blended across the triangle
+    TEXTURED  // texels from a buffer_t at per vertex coordinates
+  };
+
+  // screen space vertex for triangle(). depth is 1/z scaled so that the
+  // near plane is FIXED_ONE, larger is nearer.
+  struct vertex_t {
+    fixed_t x, y;
+    fixed_t depth;
+    pen_t pen;
+    fixed_t u, v;   // texel coordinates
+  };
+
+  // draws a triangle with the given shading, textures must be a power of
+  // two in each dimension and wrap. the pen of the first vertex is used for
+  // FLAT. triangles are drawn whichever way they wind.
+  void triangle(const vertex_t &a, const vertex_t &b, const vertex_t &c,
+                shading_t shading, const buffer_t *texture = nullptr);
+
+  // indexed triangle mesh, only the arrays needed for the shading used have
+  // to be provided. triangles wind clockwise on screen when facing the
+  // camera.
+  struct mesh_t {
+    const vec3_t *vertices;
+    uint32_t vertex_count;
+    const uint16_t *indices;  // three per triangle
+    uint32_t triangle_count;
+    const pen_t *pens;        // per triangle for FLAT, per vertex for GOURAUD
+    const fixed_t *uvs;       // u, v pairs per vertex for TEXTURED
+    const buffer_t *texture;
+  };
+
+  struct camera_t {
+    mat_t view;       // world to view space
+    fixed_t focal;    // distance to the projection plane in pixels
+    fixed_t near;
+  };
+
+  // triangles facing away from the camera are skipped unless double_sided.
+  // with no depth buffer set and sort true the visible triangles are drawn
+  // farthest first (scratch space comes from the frame arena). returns the
+  // number of triangles drawn.
+  //
+  // the view space vertices (12 bytes each) also come from the frame arena,
+  // if they don't fit nothing is drawn. with the default 16KB arena that
+  // limits meshes to about 1300 vertices, fewer with sorting or anything
+  // else allocated that frame. larger meshes need PICOSYSTEM_FRAME_ARENA_SIZE
+  // raised or splitting into parts.
+  uint32_t draw_mesh(const mesh_t &mesh, const mat_t &model, const camera_t &camera,
+                     shading_t shading, bool sort = false, bool double_sided = false);
+
+  // a buffer of _fb.w * _fb.h depths, nullptr turns depth testing off. a
+  // pixel is drawn (and its depth stored) only if it is nearer than the
+  // depth already there.
+  extern uint16_t *_depth;
+  void depth_buffer(uint16_t *depth);
+  void clear_depth();
+
+}
@@ -0,0 +1,186 @@
+#include <cstdint>
+#include <cstring>
+
+#include "packed.hpp"
+
+namespace picosystem {
+
+  // a pair of pixels p0, p1 is packed as
+  //
+  //   byte 0: r0 g0    byte 1: b0 r1    byte 2: g1 b1
+  //
+  // (high nibble first) which, read as big endian words by the scanout dma,
+  // is the same stream of 12-bit rgb values the pen_t scanout sends.
+
+  namespace {
+    constexpr uint32_t CHUNK = 64;
+
+    inline uint32_t r(pen_t p) { return p & 0xf; }
+    inline uint32_t g(pen_t p) { return p >> 12; }
+    inline uint32_t b(pen_t p) { return (p >> 8) & 0xf; }
+
+    inline pen_t opaque(uint32_t r, uint32_t g, uint32_t b) {
+      return pen_t(r | 0xf0 | (b << 8) | (g << 12));
+    }
+
+    inline pen_t get(const uint8_t *row, uint32_t i) {
+      const uint8_t *q = row + (i >> 1) * 3;
+      return i & 1 ? opaque(q[1] & 0xf, q[2] >> 4, q[2] & 0xf)
+                   : opaque(q[0] >> 4, q[0] & 0xf, q[1] >> 4);
+    }
+
+    inline void put(uint8_t *row, uint32_t i, pen_t p) {
+      uint8_t *q = row + (i >> 1) * 3;
+      if(i & 1) {
+        q[1] = (q[1] & 0xf0) | r(p);
+        q[2] = (g(p) << 4) | b(p);
+      }else{
+        q[0] = (r(p) << 4) | g(p);
+        q[1] = (b(p) << 4) | (q[1] & 0x0f);
+      }
+    }
+
+    // spans of a row starting at any pixel
+    void unpack_span(const uint8_t *row, uint32_t x, pen_t *dest, uint32_t count) {
+      if(count && (x & 1)) {
+        *dest++ = get(row, x++);
+        count--;
+      }
+      unpack(row + (x >> 1) * 3, dest, count);
+    }
+
+    void pack_span(const pen_t *src, uint8_t *row, uint32_t x, uint32_t count) {
+      if(count && (x & 1)) {
+        put(row, x++, *src++);
+        count--;
+      }
+      pack(src, row + (x >> 1) * 3, count);
+    }
+
+    // repeats the three byte pattern of a pixel pair, a word at a time once
+    // the destination is aligned
+    void fill_pairs(uint8_t *q, uint32_t pairs, const uint8_t pattern[3]) {
+      uint32_t n = pairs * 3, phase = 0;
+      while(n && (uintptr_t(q) & 3)) {
+        *q++ = pattern[phase];
+        phase = phase == 2 ? 0 : phase + 1;
+        n--;
+      }
+
+      if(n >= 12) {
+        uint8_t bytes[12];
+        for(uint32_t i = 0; i < 12; i++) bytes[i] = pattern[(phase + i) % 3];
+        uint32_t words[3];
+        memcpy(words, bytes, sizeof(words));
+
+        uint32_t *w = (uint32_t *)q;
+        for(; n >= 12; n -= 12, w += 3) {
+          w[0] = words[0]; w[1] = words[1]; w[2] = words[2];
+        }
+        q = (uint8_t *)w;
+      }
+
+      while(n--) {
+        *q++ = pattern[phase];
+        phase = phase == 2 ? 0 : phase + 1;
+      }
+    }
+
+    // unpacks up to CHUNK pixels at a time, blends into them, and packs
+    // them again
+    void blend_span(pen_t *src, uint32_t step, uint8_t *row, uint32_t x, uint32_t count, blend_func_t bf) {
+      pen_t pixels[CHUNK];
+      while(count) {
+        uint32_t n = std::min(count, CHUNK);
+        unpack_span(row, x, pixels, n);
+        bf(src, step, pixels, n);
+        pack_span(pixels, row, x, n);
+        src += step * n;
+        x += n;
+        count -= n;
+      }
+    }
+  }
+
+  void pack(const pen_t *src, uint8_t *dest, uint32_t count) {
+    for(; count >= 2; count -= 2, src += 2, dest += 3) {
+      pen_t p0 = src[0], p1 = src[1];
+      dest[0] = (r(p0) << 4) | g(p0);
+      dest[1] = (b(p0) << 4) | r(p1);
+      dest[2] = (g(p1) << 4) | b(p1);
+    }
+    if(count) put(dest, 0, *src);
+  }
+
+  void unpack(const uint8_t *src, pen_t *dest, uint32_t count) {
+    for(; count >= 2; count -= 2, src += 3, dest += 2) {
+      dest[0] = opaque(src[0] >> 4, src[0] & 0xf, src[1] >> 4);
+      dest[1] = opaque(src[1] & 0xf, src[2] >> 4, src[2] & 0xf);
+    }
+    if(count) *dest = get(src, 0);
+  }
+
+  void pack(const buffer_t &src, packed_buffer_t &dest) {
+    pack(src.data, dest.data, src.w * src.h);
+  }
+
+  void unpack(const packed_buffer_t &src, buffer_t &dest) {
+    unpack(src.data, dest.data, src.w * src.h);
+  }
+
+  void packed_rectangle(packed_buffer_t &pb, int32_t x, int32_t y, int32_t w, int32_t h,
+                        pen_t p, blend_func_t bf) {
+    int32_t x0 = std::max<int32_t>(x, 0), y0 = std::max<int32_t>(y, 0);
+    int32_t x1 = std::min<int32_t>(x + w, pb.w), y1 = std::min<int32_t>(y + h, pb.h);
+    if(x0 >= x1 || y0 >= y1) return;
+
+    uint32_t stride = pb.w / 2 * 3;
+    uint8_t *row = pb.data + y0 * stride;
+
+    if(bf != COPY) {
+      for(int32_t py = y0; py < y1; py++, row += stride) {
+        blend_span(&p, 0, row, x0, x1 - x0, bf);
+      }
+      return;
+    }
+
+    const uint8_t pattern[3] = {
+      uint8_t((r(p) << 4) | g(p)), uint8_t((b(p) << 4) | r(p)), uint8_t((g(p) << 4) | b(p))
+    };
+
+    // odd pixels at either end share their bytes with a neighbour
+    bool lead = x0 & 1, trail = x1 & 1;
+    uint32_t first = (x0 + 1) >> 1, pairs = (x1 >> 1) - first;
+
+    for(int32_t py = y0; py < y1; py++, row += stride) {
+      if(lead) put(row, x0, p);
+      fill_pairs(row + first * 3, pairs, pattern);
+      if(trail) put(row, x1 - 1, p);
+    }
+  }
+
+  void packed_blit(packed_buffer_t &pb, const buffer_t &src, int32_t x, int32_t y, int32_t w, int32_t h,
+                   int32_t dx, int32_t dy, blend_func_t bf) {
+    // clip to both buffers, moving the source and destination together
+    if(x < 0) { w += x; dx -= x; x = 0; }
+    if(y < 0) { h += y; dy -= y; y = 0; }
+    if(dx < 0) { w += dx; x -= dx; dx = 0; }
+    if(dy < 0) { h += dy; y -= dy; dy = 0; }
+    w = std::min<int32_t>({w, int32_t(src.w) - x, int32_t(pb.w) - dx});
+    h = std::min<int32_t>({h, int32_t(src.h) - y, int32_t(pb.h) - dy});
+    if(w <= 0 || h <= 0) return;
+
+    uint32_t stride = pb.w / 2 * 3;
+    uint8_t *row = pb.data + dy * stride;
+    pen_t *s = src.data + y * src.w + x;
+
+    for(int32_t py = 0; py < h; py++, row += stride, s += src.w) {
+      if(bf == COPY) {
+        pack_span(s, row, dx, w);
+      }else{
+        blend_span(s, 1, row, dx, w, bf);
+      }
+    }
+  }
+
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // packed rgb444 buffers
+  //
+  // the screen only takes 12 bits per pixel so pen_t's alpha nibble is
+  // wasted in a framebuffer. a packed buffer stores each pair of pixels in
+  // three bytes in the order they are sent, rrrrgggg bbbbrrrr ggggbbbb, which
+  // needs 25% less memory and lets the screen pio stream the frame straight
+  // out without skipping anything.
+  //
+  // widths must be even so that rows start on a byte. pixels read back from
+  // a packed buffer are opaque.
+  struct packed_buffer_t {
+    uint32_t w, h;
+    uint8_t *data;
+  };
+
+  constexpr uint32_t packed_size(uint32_t w, uint32_t h) {
+    return w * h * 3 / 2;
+  }
+
+  // as rectangle() and blit() but into a packed buffer, clipped to its
+  // bounds. any blend function can be used, the pixels are unpacked, blended
+  // as normal, and packed again so the results are identical to drawing
+  // into a pen_t buffer. COPY is done directly on the packed data.
+  void packed_rectangle(packed_buffer_t &b, int32_t x, int32_t y, int32_t w, int32_t h,
+                        pen_t p, blend_func_t bf = COPY);
+  void packed_blit(packed_buffer_t &b, const buffer_t &src, int32_t x, int32_t y, int32_t w, int32_t h,
+                   int32_t dx, int32_t dy, blend_func_t bf = COPY);
+
+  void pack(const pen_t *src, uint8_t *dest, uint32_t count);
+  void unpack(const uint8_t *src, pen_t *dest, uint32_t count);
+
+  // whole buffers of the same size
+  void pack(const buffer_t &src, packed_buffer_t &dest);
+  void unpack(const packed_buffer_t &src, buffer_t &dest);
+
+  // flips send b (which must be the size of the screen) with the packed
+  // scanout program instead of the screen buffer, nullptr goes back to
+  // the screen buffer. waits for any flip in progress. post processing in
+  // the scanout only applies to the screen buffer.
+  void screen_packed(const packed_buffer_t *b);
+  bool packed_scanout();
+
+}
@@ -0,0 +1,153 @@
+#include <cstdint>
+#include <cstring>
+
+#include "particles.hpp"
+
+namespace picosystem {
+
+  int32_t emit(particles_t &p, fixed_t x, fixed_t y, fixed_t vx, fixed_t vy,
+               uint16_t life, pen_t pen, uint8_t mode) {
+    if(p.count == p.capacity) return -1;
+
+    uint32_t i = p.count++;
+    p.x[i] = x;
+    p.y[i] = y;
+    p.vx[i] = vx;
+    p.vy[i] = vy;
+    p.life[i] = life;
+    p.pen[i] = pen;
+    p.mode[i] = mode;
+    return i;
+  }
+
+  void integrate(particles_t &p, fixed_t ax, fixed_t ay) {
+    // one axis at a time keeps each loop down to two streams
+    fixed_t *x = p.x, *vx = p.vx;
+    for(uint32_t i = 0; i < p.count; i++) {
+      vx[i] += ax;
+      x[i] += vx[i];
+    }
+
+    fixed_t *y = p.y, *vy = p.vy;
+    for(uint32_t i = 0; i < p.count; i++) {
+      vy[i] += ay;
+      y[i] += vy[i];
+    }
+  }
+
+  static void bounce_axis(fixed_t *v, fixed_t *dv, uint32_t count, fixed_t lo, fixed_t hi) {
+    for(uint32_t i = 0; i < count; i++) {
+      if(v[i] < lo) {
+        v[i] = lo + (lo - v[i]);
+        dv[i] = -dv[i];
+      }else if(v[i] > hi) {
+        v[i] = hi - (v[i] - hi);
+        dv[i] = -dv[i];
+      }
+    }
+  }
+
+  void bounce(particles_t &p, fixed_t x0, fixed_t y0, fixed_t x1, fixed_t y1) {
+    bounce_axis(p.x, p.vx, p.count, x0, x1);
+    bounce_axis(p.y, p.vy, p.count, y0, y1);
+  }
+
+  void age(particles_t &p) {
+    uint32_t i = 0;
+    while(i < p.count) {
+      if(p.life[i] > 1) {
+        p.life[i]--;
+        i++;
+        continue;
+      }
+
+      // expired, move the last particle into this slot
+      uint32_t last = --p.count;
+      p.x[i] = p.x[last];
+      p.y[i] = p.y[last];
+      p.vx[i] = p.vx[last];
+      p.vy[i] = p.vy[last];
+      p.life[i] = p.life[last];
+      p.pen[i] = p.pen[last];
+      p.mode[i] = p.mode[last];
+    }
+  }
+
+  // least significant digit radix sort of particle indices by one byte of
+  // their sort key, passes where every key shares the same byte are skipped
+  static uint16_t *radix_pass(const particles_t &p, uint16_t *in, uint16_t *out, uint32_t shift) {
+    uint32_t counts[256] = {0};
+    for(uint32_t i = 0; i < p.count; i++) {
+      uint32_t key = (p.mode[in[i]] << 16) | p.pen[in[i]];
+      counts[(key >> shift) & 0xff]++;
+    }
+
+    uint32_t sum = 0;
+    for(uint32_t b = 0; b < 256; b++) {
+      if(counts[b] == p.count) return in;
+      uint32_t c = counts[b];
+      counts[b] = sum;
+      sum += c;
+    }
+
+    for(uint32_t i = 0; i < p.count; i++) {
+      uint32_t key = (p.mode[in[i]] << 16) | p.pen[in[i]];
+      out[counts[(key >> shift) & 0xff]++] = in[i];
+    }
+
+    return out;
+  }
+
+  void draw(const particles_t &p, const blend_func_t *modes, int32_t size) {
+    if(!p.count) return;
+
+    blend_func_t bf = _bf;
+    pen_t pen = _pen;
+
+    // the sort space is only needed while drawing
+    uint32_t mark = _frame_arena.used;
+    uint16_t *order = frame_array<uint16_t>(p.count);
+    uint16_t *scratch = frame_array<uint16_t>(p.count);
+    if(!scratch) {
+      order = nullptr;
+    }
+
+    if(order) {
+      for(uint32_t i = 0; i < p.count; i++) order[i] = i;
+
+      for(uint32_t shift = 0; shift < 24; shift += 8) {
+        uint16_t *sorted = radix_pass(p, order, scratch, shift);
+        if(sorted == scratch) {
+          scratch = order;
+          order = sorted;
+        }
+      }
+    }
+
+    int32_t last_mode = -1;
+    for(uint32_t j = 0; j < p.count; j++) {
+      uint32_t i = order ? order[j] : j; // unsorted if the arena is full
+
+      if(p.mode[i] != last_mode) {
+        last_mode = p.mode[i];
+        _bf = modes[last_mode];
+      }
+      _pen = p.pen[i];
+
+      int32_t x = from_fixed(p.x[i]), y = from_fixed(p.y[i]), w = size, h = size;
+      clip_rect(x, y, w, h);
+      if(w <= 0 || h <= 0) continue;
+
+      pen_t *dest = _fb.data + offset(x, y);
+      while(h--) {
+        _bf(&_pen, 0, dest, w);
+        dest += _fb.w;
+      }
+    }
+
+    _bf = bf;
+    _pen = pen;
+    _frame_arena.used = mark;
+  }
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // particles are stored as a structure of arrays so that each batched
+  // kernel streams through only the components it needs. positions and
+  // velocities are 16.16 fixed point.
+  struct particles_t {
+    uint32_t count;
+    uint32_t capacity;
+    fixed_t *x, *y;
+    fixed_t *vx, *vy;
+    uint16_t *life;   // updates remaining before the particle is removed
+    pen_t *pen;
+    uint8_t *mode;    // index into the blend modes passed to draw()
+  };
+
+  // particles_t with storage for N particles
+  template<uint32_t N>
+  struct particle_storage_t : particles_t {
+    static_assert(N <= 65536, "sorted draws use 16-bit particle indices");
+
+    fixed_t sx[N], sy[N], svx[N], svy[N];
+    uint16_t slife[N];
+    pen_t spen[N];
+    uint8_t smode[N];
+
+    particle_storage_t()
+      : particles_t{0, N, sx, sy, svx, svy, slife, spen, smode} {}
+  };
+
+  // adds a particle, returns its index or -1 if full
+  int32_t emit(particles_t &p, fixed_t x, fixed_t y, fixed_t vx, fixed_t vy,
+               uint16_t life, pen_t pen, uint8_t mode = 0);
+
+  // applies acceleration to velocity and then velocity to position
+  void integrate(particles_t &p, fixed_t ax, fixed_t ay);
+
+  // reflects particles that have left the bounds back inside
+  void bounce(particles_t &p, fixed_t x0, fixed_t y0, fixed_t x1, fixed_t y1);
+
+  // counts down particle lifetimes and removes the expired ones, this
+  // doesn't preserve the order of the remaining particles
+  void age(particles_t &p);
+
+  // draws each particle as a size x size square. particles are sorted by
+  // blend mode and pen (using scratch space from the frame arena) so that
+  // state only changes between runs.
+  void draw(const particles_t &p, const blend_func_t *modes, int32_t size = 1);
+
+}
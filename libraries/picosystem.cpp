@@ -8,6 +8,11 @@
 #include <vector>
 
 #include "picosystem.hpp"
+#include "save.hpp"
+#include "replay.hpp"
+#include "governor.hpp"
+#include "task.hpp"
+#include "packed.hpp"
 
 namespace picosystem {
 
@@ -17,6 +22,13 @@ namespace picosystem {
   blend_func_t _bf = BLEND;
   buffer_t _fb{.w = 240, .h = 240, .data = _framebuffer};
 
+  surface_t _screen{
+    .buffer = _fb, .pen = 0, .bf = BLEND,
+    .cx = 0, .cy = 0, .cw = 240, .ch = 240, .clip_depth = 0, .clip_stack = {}
+  };
+  surface_t *_target = &_screen;
+  uint32_t _buttons = 0;
+
   void COPY(pen_t *source, uint32_t source_step, pen_t *dest, uint32_t count) {
     if(source_step) {
       // for blits (i.e. source_step == 1) we're unlikely to do much
@@ -46,7 +58,7 @@ namespace picosystem {
 
       // finish off with last pixel if needed
       if(count) {
-        *dest = *source;
+        *(pen_t *)dwd = *source;
       }
     }
   }
@@ -92,11 +104,13 @@ namespace picosystem {
 
   void pen(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
     _pen = create_pen(r, g, b, a);
+    _dither = false;
   }
   void pen(uint8_t r, uint8_t g, uint8_t b) {
     _pen = create_pen(r, g, b, 255);
+    _dither = false;
   }
-  void pen(pen_t p) { _pen = p; }
+  void pen(pen_t p) { _pen = p; _dither = false; }
 
   void clip(int32_t x, int32_t y, uint32_t w, uint32_t h) {
     _cx = x; _cy = y; _cw = w; _ch = h;
@@ -104,8 +118,12 @@ namespace picosystem {
 
   void blend_mode(blend_func_t bf) {_bf = bf;}
 
+  bool pressed(uint32_t button) {
+    return _buttons & (1U << button);
+  }
+
   void clear() {
-    rectangle(0, 0, 240, 240);
+    rectangle(0, 0, _fb.w, _fb.h);
   }
 
 /*
@@ -118,49 +136,318 @@ return Rect(std::max(x, r.x),
   void clip_rect(int32_t &x, int32_t &y, int32_t &w, int32_t &h) {
     int32_t mx = std::max(x, _cx);
     int32_t my = std::max(y, _cy);
-    w = std::max(0L, std::min(x + w, _cx + _cw) - mx);
-    h = std::max(0L, std::min(y + h, _cy + _ch) - my);
+    w = std::max<int32_t>(0, std::min(x + w, _cx + _cw) - mx);
+    h = std::max<int32_t>(0, std::min(y + h, _cy + _ch) - my);
     x = mx;
     y = my;
   }
 
   bool clip_contains(int32_t x, int32_t y) {
-    return x >= _cx && x < _cx + _cw && y >= _cy && y < _cy + _cw;
+    return x >= _cx && x < _cx + _cw && y >= _cy && y < _cy + _ch;
   }
 
   uint32_t offset(int32_t x, int32_t y) {
     return x + y * _fb.w;
   }
 
+  static bool use_dma(int32_t w, int32_t h) {
+    return w >= PICOSYSTEM_DMA_MIN_ROW && w * h >= PICOSYSTEM_DMA_MIN_PIXELS;
+  }
+
   void rectangle(int32_t x, int32_t y, int32_t w, int32_t h) {
+    if(_dither) {
+      dither_rectangle(x, y, w, h);
+      return;
+    }
+
     clip_rect(x, y, w, h);
 
     pen_t *dest = _fb.data + offset(x, y);
 
+    // the dma's control blocks are only needed until it has finished
+    uint32_t mark = _frame_arena.used;
+    if(_bf == COPY && use_dma(w, h) && dma_fill(dest, _fb.w, w, h, _pen)) {
+      dma_wait();
+      _frame_arena.used = mark;
+      return;
+    }
+
     while(h--) {
       _bf(&_pen, 0, dest, w); // draw row
       dest += _fb.w;
     }
   }
 
+  // clips a blit to the source buffer and the clip rectangle, returns
+  // false if there is nothing left to draw
+  static bool clip_blit(const buffer_t &src, int32_t &x, int32_t &y, int32_t &w, int32_t &h, int32_t &dx, int32_t &dy) {
+    // clamp the source rectangle to the source buffer
+    if(x < 0) {w += x; dx -= x; x = 0;}
+    if(y < 0) {h += y; dy -= y; y = 0;}
+    w = std::min(w, int32_t(src.w) - x);
+    h = std::min(h, int32_t(src.h) - y);
+
+    // clip the destination and move the source origin to match
+    int32_t cx = dx, cy = dy;
+    clip_rect(cx, cy, w, h);
+    if(w <= 0 || h <= 0) return false;
+
+    x += cx - dx;
+    y += cy - dy;
+    dx = cx;
+    dy = cy;
+    return true;
+  }
+
+  void blit(const buffer_t &src, int32_t x, int32_t y, int32_t w, int32_t h, int32_t dx, int32_t dy) {
+    if(!clip_blit(src, x, y, w, h, dx, dy)) return;
+
+    pen_t *s = src.data + x + y * src.w;
+    pen_t *d = _fb.data + offset(dx, dy);
+
+    uint32_t mark = _frame_arena.used;
+    if(_bf == COPY && use_dma(w, h) && dma_copy(s, src.w, d, _fb.w, w, h)) {
+      dma_wait();
+      _frame_arena.used = mark;
+      return;
+    }
+
+    while(h--) {
+      _bf(s, 1, d, w); // draw row
+      s += src.w;
+      d += _fb.w;
+    }
+  }
+
+  void clear_async() {
+    int32_t x = 0, y = 0, w = _fb.w, h = _fb.h;
+    clip_rect(x, y, w, h);
+
+    if(!dma_fill(_fb.data + offset(x, y), _fb.w, w, h, _pen)) {
+      blend_func_t bf = _bf;
+      _bf = COPY;
+      rectangle(x, y, w, h);
+      _bf = bf;
+    }
+  }
+
+  void blit_async(const buffer_t &src, int32_t x, int32_t y, int32_t w, int32_t h, int32_t dx, int32_t dy) {
+    if(!clip_blit(src, x, y, w, h, dx, dy)) return;
+
+    pen_t *s = src.data + x + y * src.w;
+    pen_t *d = _fb.data + offset(dx, dy);
+
+    if(!dma_copy(s, src.w, d, _fb.w, w, h)) {
+      while(h--) {
+        COPY(s, 1, d, w);
+        s += src.w;
+        d += _fb.w;
+      }
+    }
+  }
+
+  surface_t create_surface(const buffer_t &b) {
+    return surface_t{
+      .buffer = b, .pen = 0, .bf = BLEND,
+      .cx = 0, .cy = 0, .cw = int32_t(b.w), .ch = int32_t(b.h),
+      .clip_depth = 0, .clip_stack = {}
+    };
+  }
+
+  void target(surface_t &s) {
+    // store the active state back into the current surface
+    _target->pen = _pen; _target->bf = _bf;
+    _target->cx = _cx; _target->cy = _cy; _target->cw = _cw; _target->ch = _ch;
+
+    _target = &s;
+    _fb = s.buffer;
+    _pen = s.pen; _bf = s.bf;
+    _cx = s.cx; _cy = s.cy; _cw = s.cw; _ch = s.ch;
+  }
+
+  void target() {
+    target(_screen);
+  }
+
+  void push_clip(int32_t x, int32_t y, int32_t w, int32_t h) {
+    // with the stack full the push is only counted so that its pop is
+    // matched, the clip is left as it is
+    if(_target->clip_depth >= 8) {
+      if(_target->clip_depth < UINT8_MAX) _target->clip_depth++;
+      return;
+    }
+
+    int32_t *c = _target->clip_stack[_target->clip_depth++];
+    c[0] = _cx; c[1] = _cy; c[2] = _cw; c[3] = _ch;
+
+    // new clip is the intersection with the current one
+    clip_rect(x, y, w, h);
+    _cx = x; _cy = y; _cw = w; _ch = h;
+  }
+
+  void pop_clip() {
+    if(_target->clip_depth == 0) return;
+    if(_target->clip_depth-- > 8) return; // pushed while full
+
+    int32_t *c = _target->clip_stack[_target->clip_depth];
+    _cx = c[0]; _cy = c[1]; _cw = c[2]; _ch = c[3];
+  }
+
+  void compose(layer_t *layers, uint32_t count) {
+    for(uint32_t i = 0; i < count; i++) {
+      layer_t &l = layers[i];
+
+      // rebuild the cached layer contents if needed
+      if(l.dirty) {
+        surface_t *previous = _target;
+        target(l.surface);
+        l.draw();
+        target(*previous);
+        l.dirty = false;
+      }
+
+      // COPY layers take the memcpy fast path
+      blend_func_t bf = _bf;
+      _bf = l.bf;
+      blit(l.surface.buffer, 0, 0, l.surface.buffer.w, l.surface.buffer.h, l.x, l.y);
+      _bf = bf;
+    }
+  }
+
   std::string str(float v, uint8_t precision) {
-    static char b[32];
-    snprintf(b, 32, "%.*f", precision, v);
-    return b;
+    char b[24];
+    return std::string(b, format(b, v, precision));
   }
 
   std::string str(uint32_t v) {
-    static char b[32];
-    snprintf(b, 32, "%d", v);
-    return b;
+    char b[12];
+    return std::string(b, format(b, v));
   }
 
-  void text(const std::string &t, int32_t x, int32_t y) {
+  // two digits at a time halves the number of divisions needed
+  static const char digit_pairs[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+  static const uint32_t powers_of_ten[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+  uint32_t format(char *b, uint32_t v) {
+    // build the digits backwards from the end of a scratch buffer
+    char t[10];
+    char *p = t + 10;
+
+    while(v >= 100) {
+      uint32_t r = v % 100;
+      v /= 100;
+      p -= 2;
+      p[0] = digit_pairs[r * 2];
+      p[1] = digit_pairs[r * 2 + 1];
+    }
+
+    if(v >= 10) {
+      p -= 2;
+      p[0] = digit_pairs[v * 2];
+      p[1] = digit_pairs[v * 2 + 1];
+    }else{
+      *--p = '0' + v;
+    }
+
+    uint32_t n = t + 10 - p;
+    memcpy(b, p, n);
+    return n;
+  }
+
+  uint32_t format(char *b, int32_t v) {
+    if(v < 0) {
+      *b = '-';
+      return format(b + 1, uint32_t(0) - uint32_t(v)) + 1;
+    }
+
+    return format(b, uint32_t(v));
+  }
+
+  // writes the integer part, a decimal point, and then `precision` digits
+  // of fraction (which must already be scaled and rounded)
+  static uint32_t format_parts(char *b, uint32_t i, uint32_t f, uint8_t precision) {
+    uint32_t n = format(b, i);
+    if(!precision) return n;
+
+    b[n++] = '.';
+    for(uint8_t d = precision; d > 0; d--) {
+      b[n + d - 1] = '0' + (f % 10);
+      f /= 10;
+    }
+
+    return n + precision;
+  }
+
+  uint32_t format(char *b, float v, uint8_t precision) {
+    if(v != v) {
+      memcpy(b, "nan", 3);
+      return 3;
+    }
+
+    uint32_t n = 0;
+    if(v < 0.0f) {
+      b[n++] = '-';
+      v = -v;
+    }
+
+    if(v >= 4294967295.0f) {
+      memcpy(b + n, "inf", 3);
+      return n + 3;
+    }
+
+    precision = std::min<uint8_t>(precision, 8);
+
+    // split into integer and fraction so that only 32-bit maths is needed
+    // and round the fraction once, carrying into the integer part
+    uint32_t scale = powers_of_ten[precision];
+    uint32_t i = uint32_t(v);
+    uint32_t f = uint32_t((v - float(i)) * float(scale) + 0.5f);
+    if(f >= scale) {
+      i++;
+      f -= scale;
+    }
+
+    return n + format_parts(b + n, i, f, precision);
+  }
+
+  uint32_t format_fixed(char *b, int32_t v, uint8_t fraction_bits, uint8_t precision) {
+    uint32_t n = 0;
+    uint32_t m = uint32_t(v);
+    if(v < 0) {
+      b[n++] = '-';
+      m = uint32_t(0) - m;
+    }
+
+    precision = std::min<uint8_t>(precision, 8);
+
+    uint32_t scale = powers_of_ten[precision];
+    uint32_t mask = (uint32_t(1) << fraction_bits) - 1;
+    uint32_t i = m >> fraction_bits;
+    uint64_t rounding = fraction_bits ? uint64_t(1) << (fraction_bits - 1) : 0;
+    uint32_t f = uint32_t((uint64_t(m & mask) * scale + rounding) >> fraction_bits);
+    if(f >= scale) {
+      i++;
+      f -= scale;
+    }
+
+    return n + format_parts(b + n, i, f, precision);
+  }
+
+  void text(std::string_view t, int32_t x, int32_t y) {
+    if(_font) {
+      text(_font, t, x, y);
+      return;
+    }
+
     uint32_t co = 0, lo = 0; // character and line (if wrapping) offset
     uint32_t wrap = INT_MAX; // should be a flag?
 
     for(std::size_t i = 0, len = t.length(); i < len; i++) {
-      const uint8_t *d = &font8x8_basic[t[i]][0];
+      const uint8_t *d = &font8x8_basic[uint8_t(t[i]) & 0x7f][0];
       for(uint8_t cy = 0; cy < 8; cy++) {
         for(uint8_t cx = 0; cx < 8; cx++) {
           if((1U << cx) & *d && clip_contains(x + cx + co, y + cy + lo)) {
@@ -186,6 +473,27 @@ return Rect(std::max(x, r.x),
     }
   }
 
+  // standard (reflected 0xedb88320) crc32 a nibble at a time, the 64 byte
+  // table is a fair trade against 1kb for a full byte table
+  uint32_t crc32(const void *data, uint32_t length, uint32_t crc) {
+    static const uint32_t table[16] = {
+      0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+      0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+      0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+      0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+    };
+
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    while(length--) {
+      crc ^= *p++;
+      crc = (crc >> 4) ^ table[crc & 0xf];
+      crc = (crc >> 4) ^ table[crc & 0xf];
+    }
+
+    return ~crc;
+  }
+
 
 }
 
@@ -207,35 +515,87 @@ int main() {
   uint32_t update_rate_ms = 10;
   uint32_t pending_update_ms = 0;
   uint32_t last_ms = time();
+  uint32_t now = last_ms;
+
+  // time spent in update() and render() over the last frame, for the clock
+  // governor
+  uint32_t busy_us = 0;
+  uint32_t frame_start_us = time_us();
 
   while(true) {
+    // release anything allocated from the frame arena last time around
+    reset(_frame_arena);
+
+    uint32_t start_us = time_us();
+
     uint32_t ms = time();
+    uint32_t elapsed = ms - last_ms;
+    last_ms = ms;
+
+    // take one snapshot of the buttons for the whole frame so that the
+    // clock and input can be recorded (or replayed) together
+    uint32_t buttons = read_buttons();
+    replay_frame(now, pending_update_ms, elapsed, buttons);
+    _buttons = buttons;
+    now += elapsed;
 
     // work out how many milliseconds of updates we're waiting
     // to process and then call the users update() function as
     // many times as needed to catch up
-    pending_update_ms += (ms - last_ms);
+    pending_update_ms += elapsed;
     while(pending_update_ms >= update_rate_ms) {
-      update(ms - pending_update_ms);
+      update(now - pending_update_ms);
       pending_update_ms -= update_rate_ms;
     }
 
-    // if current flipping the framebuffer in the background
-    // then wait until that is complete before allow the user
-    // to render
-    while(is_flipping()) {}
+    // scripts and other frame tasks see the world after this frame's updates
+    tasks_frame(now);
+
+    busy_us += time_us() - start_us;
+
+    // if currently flipping the framebuffer in the background
+    // then sleep until that is complete before allowing the user
+    // to render. while the dma is busy is also the one time that
+    // stalling the cpu for flash writes costs nothing, and any time
+    // left over goes to background tasks. an erase outlasts the transfer
+    // so the save store gets one go per frame
+    bool saved = false;
+    while(is_flipping()) {
+      if(!saved && is_transferring()) {
+        saved = true;
+        if(save_service()) continue;
+      }
+      if(tasks_background()) continue;
+      idle();
+    }
+
+    // the screen dma is idle between frames so this is the safe point to
+    // change the clock
+    uint32_t frame_end_us = time_us();
+    governor_frame(busy_us, frame_end_us - frame_start_us);
+    frame_start_us = frame_end_us;
+    busy_us = 0;
+
+    start_us = time_us();
 
     // call user render function to draw world
     render();
 
-    // wait for the screen to vsync before triggering flip
-    // to ensure no tearing
-    wait_vsync();
+    // any drawing still in progress on the dma has to land before the
+    // frame is checked or sent
+    dma_wait();
+    replay_rendered();
 
-    // flip the framebuffer to the screen
-    flip();
+    busy_us += time_us() - start_us;
 
-    last_ms = ms;
+    // queue the flip of the framebuffer to the screen, the transfer
+    // is started by the vsync interrupt to ensure no tearing
+
+    if(!post_in_scanout() && !packed_scanout()) {
+      post_process(_screen.buffer);
+    }
+
+    flip();
   }
 
 
@@ -2,6 +2,12 @@
 
 #include <memory>
 #include <cstdint>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <algorithm>
+#include <new>
+#include <utility>
 
 extern void init();
 extern void update(uint32_t time_ms);
@@ -11,6 +17,12 @@ namespace picosystem {
 
   typedef uint16_t pen_t;
 
+  // 16.16 fixed point
+  typedef int32_t fixed_t;
+  constexpr fixed_t FIXED_ONE = 1 << 16;
+  constexpr fixed_t to_fixed(float v) { return fixed_t(v * float(FIXED_ONE)); }
+  constexpr int32_t from_fixed(fixed_t v) { return v >> 16; }
+
   struct buffer_t {
     uint32_t w, h;
     pen_t *data;
@@ -19,6 +31,11 @@ namespace picosystem {
   using blend_func_t = void(*)(pen_t* source, uint32_t source_step, pen_t* dest, uint32_t count);
   extern void COPY(pen_t* source, uint32_t source_step, pen_t* dest, uint32_t count);
   extern void BLEND(pen_t* source, uint32_t source_step, pen_t* dest, uint32_t count);
+  extern void ADD(pen_t* source, uint32_t source_step, pen_t* dest, uint32_t count);
+  extern void SUBTRACT(pen_t* source, uint32_t source_step, pen_t* dest, uint32_t count);
+  extern void MULTIPLY(pen_t* source, uint32_t source_step, pen_t* dest, uint32_t count);
+  extern void SCREEN(pen_t* source, uint32_t source_step, pen_t* dest, uint32_t count);
+  extern void ALPHA(pen_t* source, uint32_t source_step, pen_t* dest, uint32_t count);
 
   extern pen_t _pen;
   extern int32_t _cx, _cy, _cw, _ch;
@@ -38,7 +55,33 @@ namespace picosystem {
 
   void clear();
   void rectangle(int32_t x, int32_t y, int32_t w, int32_t h);
-  void text(const std::string &t, int32_t x, int32_t y);
+
+  // ordered dither fills, colours between pen levels are drawn as a 4x4
+  // bayer pattern. dither_pen() takes 8-bit channels and applies to
+  // rectangle() and clear() until the next call to pen().
+  extern bool _dither;
+  void dither_pen(uint8_t r, uint8_t g, uint8_t b, uint8_t a = 255);
+  void dither_rectangle(int32_t x, int32_t y, int32_t w, int32_t h);
+  void linear_gradient(int32_t x, int32_t y, int32_t w, int32_t h,
+                       int32_t x0, int32_t y0, pen_t from, int32_t x1, int32_t y1, pen_t to);
+  void radial_gradient(int32_t x, int32_t y, int32_t w, int32_t h,
+                       int32_t cx, int32_t cy, int32_t radius, pen_t inner, pen_t outer);
+
+  // post processing, applied to the whole screen after render(). either a
+  // table per channel (fades, brightness, curves) or a colour matrix in 8.8
+  // fixed point with a row per output channel of {r, g, b, offset}. with
+  // post_scanout() it's applied as the frame is sent to the screen instead
+  // so the framebuffer is never rewritten.
+  void post_lut(const uint8_t r[16], const uint8_t g[16], const uint8_t b[16]);
+  void post_fade(pen_t to, uint8_t amount);
+  void post_matrix(const int16_t m[3][4]);
+  void post_off();
+  void post_scanout(bool enabled);
+  bool post_in_scanout();
+  void post_line(const pen_t *src, pen_t *dest, uint32_t count);
+  void post_process(buffer_t &b);
+
+  void text(std::string_view t, int32_t x, int32_t y);
   void clip_rect(int32_t &x, int32_t &y, int32_t &w, int32_t &h);
   bool clip_contains(int32_t x, int32_t y);
   uint32_t offset(int32_t x, int32_t y);
@@ -47,40 +90,247 @@ namespace picosystem {
   std::string str(float v, uint8_t precision);
   std::string str(uint32_t v);
 
+  // formatting that never touches the heap or snprintf, each writes into
+  // the caller's buffer and returns the number of characters written (no
+  // terminator). b must have room for 11 characters for integers and 12 +
+  // precision characters for fractional values.
+  uint32_t format(char *b, uint32_t v);
+  uint32_t format(char *b, int32_t v);
+  uint32_t format(char *b, float v, uint8_t precision);
+  uint32_t format_fixed(char *b, int32_t v, uint8_t fraction_bits, uint8_t precision);
+
+  // fixed capacity string builder for composing text on the stack, e.g.
+  //
+  //   text(strbuf_t<32>() << "battery: " << charge(), 10, 30);
+  //
+  // anything that doesn't fit is dropped
+  template<uint32_t N = 64>
+  struct strbuf_t {
+    char data[N];
+    uint32_t length = 0;
+    uint8_t precision = 2; // decimal places used for floats
+
+    strbuf_t &operator<<(std::string_view s) {
+      uint32_t n = std::min<uint32_t>(s.length(), N - length);
+      for(uint32_t i = 0; i < n; i++) data[length + i] = s[i];
+      length += n;
+      return *this;
+    }
+
+    strbuf_t &operator<<(char c) {
+      if(length < N) data[length++] = c;
+      return *this;
+    }
+
+    template<typename T, typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, char>::value, int>::type = 0>
+    strbuf_t &operator<<(T v) {
+      char b[12];
+      uint32_t n = std::is_signed<T>::value ? format(b, int32_t(v)) : format(b, uint32_t(v));
+      return *this << std::string_view(b, n);
+    }
+
+    strbuf_t &operator<<(float v) {
+      char b[24];
+      return *this << std::string_view(b, format(b, v, precision));
+    }
+
+    void clear() { length = 0; }
+    operator std::string_view() const { return std::string_view(data, length); }
+  };
+
+  // buttons are read once per frame by the main loop into _buttons (bit n
+  // is gpio n) so that they can't change part way through an update
+  extern uint32_t _buttons;
   bool pressed(uint32_t button);
+  uint32_t read_buttons();
   void led(uint8_t r, uint8_t g, uint8_t b);
 
-  // blending functions
-/*
-  struct Surface {
-
-    Pen* ptr(const Rect &r);
-    Pen* ptr(const Point &p);
-    Pen* ptr(int32_t x, int32_t y);
-
-    // drawing primitives
-    void clear();
-    void pixel(int32_t x, int32_t y);
-    void rectangle(int32_t rx, int32_t ry, int32_t rw, int32_t rh);
-    void pixel_span(const Point &p, int32_t l);
-    void circle(const Point &p, int32_t radius);
-    void text(const std::string &t, int32_t x, int32_t y, int32_t wrap = -1);
-    void blit(const Surface &source, const Rect &from, const Point &to);
-
-    // utility functions
-    bool contains(int32_t x, int32_t y);
-    void clip_rect(int32_t &rx, int32_t &ry, int32_t &rw, int32_t &rh);
-    uint32_t offset(int32_t x, int32_t y) const;
+  // fades run in the background from a timer interrupt, led() and
+  // backlight() set the level straight away and cancel any fade. a pulse
+  // breathes from off up to the colour and back every period_ms.
+  void led_fade(uint8_t r, uint8_t g, uint8_t b, uint32_t ms);
+  void led_pulse(uint8_t r, uint8_t g, uint8_t b, uint32_t period_ms);
+  void backlight_fade(uint8_t brightness, uint32_t ms);
+  bool is_fading();
+
+  // memory
+  //
+  // arena_t is a bump allocator released all at once by reset(). the frame
+  // arena is reset at the top of every main loop iteration so it suits
+  // transient data like display lists and text layouts.
+  #ifndef PICOSYSTEM_FRAME_ARENA_SIZE
+  #define PICOSYSTEM_FRAME_ARENA_SIZE 16384
+  #endif
+
+  struct arena_t {
+    uint8_t *data;
+    uint32_t size;
+    uint32_t used;
+    uint32_t high_water;
+  };
+
+  extern arena_t _frame_arena;
+
+  void *alloc(arena_t &a, uint32_t size, uint32_t align = 4);
+  void reset(arena_t &a);
+  void *frame_alloc(uint32_t size, uint32_t align = 4);
+
+  // uninitialised array of count Ts from the frame arena, or nullptr
+  template<typename T>
+  T *frame_array(uint32_t count) {
+    return static_cast<T *>(frame_alloc(count * sizeof(T), alignof(T)));
+  }
+
+  // fixed capacity pool of Ts with O(1) alloc and free. free slots are kept
+  // as a stack of indices so objects of any size can be pooled.
+  template<typename T, uint32_t N>
+  struct pool_t {
+    static_assert(N <= 65536, "pool_t indices are 16-bit");
+
+    alignas(T) uint8_t slots[N][sizeof(T)];
+    uint16_t free_slots[N];
+    uint32_t free_count = N;
+    uint32_t high_water = 0;
+
+    pool_t() {
+      for(uint32_t i = 0; i < N; i++) {
+        free_slots[i] = N - 1 - i;
+      }
+    }
+
+    template<typename... A>
+    T *alloc(A&&... args) {
+      if(!free_count) return nullptr;
+
+      uint16_t i = free_slots[--free_count];
+      high_water = std::max(high_water, used());
+      return new(slots[i]) T(std::forward<A>(args)...);
+    }
+
+    void free(T *p) {
+      p->~T();
+      free_slots[free_count++] = index(p);
+    }
+
+    uint32_t index(const T *p) const {
+      return (reinterpret_cast<const uint8_t *>(p) - slots[0]) / sizeof(T);
+    }
+
+    T *at(uint32_t i) { return reinterpret_cast<T *>(slots[i]); }
+
+    uint32_t used() const { return N - free_count; }
+    uint32_t capacity() const { return N; }
+  };
+
+  // render targets
+  //
+  // a surface wraps a buffer with its own pen, blend mode, and clip stack.
+  // the active surface's state lives in the globals above so primitives
+  // don't pay for the indirection, target() swaps it in and out.
+  struct surface_t {
+    buffer_t buffer;
+    pen_t pen;
+    blend_func_t bf;
+    int32_t cx, cy, cw, ch;
+    uint8_t clip_depth;         // may be more than 8 if pushed while full
+    int32_t clip_stack[8][4];
+  };
+
+  extern surface_t _screen;
+  extern surface_t *_target;
+
+  surface_t create_surface(const buffer_t &b);
+  void target(surface_t &s);
+  void target();
+  // the clip stack is 8 deep, pushes past that leave the clip unchanged
+  // (and their pops restore nothing)
+  void push_clip(int32_t x, int32_t y, int32_t w, int32_t h);
+  void pop_clip();
+  void blit(const buffer_t &src, int32_t x, int32_t y, int32_t w, int32_t h, int32_t dx, int32_t dy);
+
+  // cached layers, redrawn into their surface only when marked dirty and
+  // then composited onto the current target with their blend function
+  struct layer_t {
+    surface_t surface;
+    void (*draw)();
+    int32_t x, y;
+    blend_func_t bf;
+    bool dirty;
   };
 
-  extern Surface &screen;*/
+  void compose(layer_t *layers, uint32_t count);
+
+  // dma drawing
+  //
+  // with COPY as the blend mode large rectangles and blits are handed to a
+  // spare dma channel which moves a word per cycle. below the thresholds the
+  // cost of setting it up outweighs the gain so the cpu draws them as before.
+  #ifndef PICOSYSTEM_DMA_MIN_ROW
+  #define PICOSYSTEM_DMA_MIN_ROW 32
+  #endif
+
+  #ifndef PICOSYSTEM_DMA_MIN_PIXELS
+  #define PICOSYSTEM_DMA_MIN_PIXELS 2048
+  #endif
+
+  // provided by the hal. these start the transfer and return straight away,
+  // or return false if it can't be started (the frame arena is full)
+  bool dma_fill(pen_t *dest, uint32_t stride, uint32_t w, uint32_t h, pen_t p);
+  bool dma_copy(const pen_t *src, uint32_t src_stride, pen_t *dest, uint32_t dest_stride, uint32_t w, uint32_t h);
+  bool dma_busy();
+  void dma_wait();
+
+  // as clear() and blit() with COPY but return while the dma is still
+  // drawing so the cpu can get on with something else. call dma_wait()
+  // before drawing over the same area, the main loop waits before flip()
+  void clear_async();
+  void blit_async(const buffer_t &src, int32_t x, int32_t y, int32_t w, int32_t h, int32_t dx, int32_t dy);
+
   extern const uint8_t font8x8_basic[128][8];
 
+  // proportional fonts, generated offline from a font file by tools/font.py
+  //
+  // each glyph row is stored as a count of runs followed by (skip, length)
+  // byte pairs so the renderer can hand whole spans to the blend function.
+  struct glyph_t {
+    uint32_t codepoint;
+    uint32_t runs;  // offset of this glyph's run data in font_t::runs
+    int8_t x, y;    // bitmap offset from the pen position and top of line
+    uint8_t w, h;
+    uint8_t advance;
+  };
+
+  struct kerning_t {
+    uint32_t left, right;
+    int8_t adjust;
+  };
+
+  struct font_t {
+    uint8_t height;             // line height
+    uint16_t glyph_count;
+    const glyph_t *glyphs;      // sorted by codepoint
+    uint16_t kerning_count;
+    const kerning_t *kerning;   // sorted by left then right codepoint
+    const uint8_t *runs;
+  };
+
+  extern const font_t *_font;
+
+  void font(const font_t *f);
+  int32_t measure(std::string_view t);
+  uint32_t utf8_next(const char *&p, const char *end);
+  const glyph_t *find_glyph(const font_t *f, uint32_t codepoint);
+  void text(const font_t *f, std::string_view t, int32_t x, int32_t y);
+
   // utility
   float charge();
   uint32_t time();
   uint32_t time_us();
   void reset_to_dfu();
+  void idle();
+
+  // crc32 of a block of data, pass a previous result as crc to continue it
+  uint32_t crc32(const void *data, uint32_t length, uint32_t crc = 0);
 
   // screen
   void backlight(uint8_t brightness);
@@ -88,6 +338,11 @@ namespace picosystem {
   void wait_vsync();
   void flip();
   bool is_flipping();
+  bool is_transferring();
+
+  // when enabled flip() checksums the framebuffer and frames identical to
+  // the last one sent are skipped, leaving the panel showing it as before
+  void skip_unchanged(bool enabled);
 
   // input pins
   enum button {
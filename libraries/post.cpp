@@ -0,0 +1,138 @@
+#include <cstdint>
+#include <cstring>
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // post processing works a byte of the pixel at a time. the low byte holds
+  // alpha and red and the high byte green and blue, so any per-channel
+  // mapping becomes two 256 entry tables and two pixels in a word take four
+  // lookups.
+  //
+  // a colour matrix mixes channels across the two bytes so instead each
+  // byte looks up its contribution to all three output channels, packed as
+  // 10-bit lanes in quarter levels. adding the two lookups gives the matrix
+  // product which is then clamped lane by lane.
+
+  namespace {
+    enum mode_t {OFF, LUT, MATRIX};
+
+    constexpr int32_t BIAS = 512; // lane value for a level of zero
+
+    mode_t _mode = OFF;
+    bool _scanout = false;
+
+    uint8_t _lo[256], _hi[256];
+    int32_t _matrix_lo[256], _matrix_hi[256];
+
+    inline uint32_t lut_pair(uint32_t w) {
+      return  _lo[w & 0xff] | (_hi[(w >> 8) & 0xff] << 8) |
+             (_lo[(w >> 16) & 0xff] << 16) | (_hi[w >> 24] << 24);
+    }
+
+    inline uint32_t lane(int32_t v) {
+      return (std::clamp<int32_t>(v - BIAS, 0, 60) + 2) >> 2;
+    }
+
+    inline pen_t matrix_pixel(pen_t p) {
+      int32_t v = _matrix_lo[p & 0xff] + _matrix_hi[p >> 8];
+      return lane(v & 0x3ff) | (p & 0xf0) |
+             (lane((v >> 20) & 0x3ff) << 8) | (lane((v >> 10) & 0x3ff) << 12);
+    }
+  }
+
+  void post_lut(const uint8_t r[16], const uint8_t g[16], const uint8_t b[16]) {
+    for(uint32_t i = 0; i < 256; i++) {
+      _lo[i] = (i & 0xf0) | (r[i & 0xf] & 0xf);
+      _hi[i] = ((g[i >> 4] & 0xf) << 4) | (b[i & 0xf] & 0xf);
+    }
+
+    _mode = LUT;
+  }
+
+  void post_fade(pen_t to, uint8_t amount) {
+    uint8_t lut[3][16];
+    uint8_t target[3] = {uint8_t(to & 0xf), uint8_t(to >> 12), uint8_t((to >> 8) & 0xf)};
+    for(uint32_t c = 0; c < 3; c++) {
+      for(uint32_t i = 0; i < 16; i++) {
+        lut[c][i] = (i * (255 - amount) + target[c] * amount + 127) / 255;
+      }
+    }
+
+    post_lut(lut[0], lut[1], lut[2]);
+  }
+
+  void post_matrix(const int16_t m[3][4]) {
+    // each contribution in quarter levels, m is 8.8 fixed point with rows
+    // for red, green, and blue out and columns for red, green, blue in and
+    // an offset in levels
+    auto contribution = [m](uint32_t out, uint32_t in, uint32_t level) {
+      return (std::clamp<int32_t>(m[out][in], -512, 512) * int32_t(level) * 4 + 128) >> 8;
+    };
+
+    for(uint32_t i = 0; i < 256; i++) {
+      int32_t lo = 0, hi = 0;
+      for(uint32_t out = 0; out < 3; out++) {
+        // red in the bottom lane, green in the middle, and blue at the top
+        int32_t offset = (std::clamp<int32_t>(m[out][3], -4096, 4096) * 4) >> 8;
+        lo += (BIAS + offset + contribution(out, 0, i & 0xf)) * (1 << (out * 10));
+        hi += (contribution(out, 1, i >> 4) + contribution(out, 2, i & 0xf)) * (1 << (out * 10));
+      }
+      _matrix_lo[i] = lo;
+      _matrix_hi[i] = hi;
+    }
+
+    _mode = MATRIX;
+  }
+
+  void post_off() {
+    _mode = OFF;
+  }
+
+  void post_scanout(bool enabled) {
+    _scanout = enabled;
+  }
+
+  bool post_in_scanout() {
+    return _mode != OFF && _scanout;
+  }
+
+  void post_line(const pen_t *src, pen_t *dest, uint32_t count) {
+    if(_mode == LUT) {
+      // align to 32bits, a pair at a time only if both spans line up
+      if(count && (uintptr_t(dest) & 0b11)) {
+        *dest++ = lut_pair(*src++);
+        count--;
+      }
+
+      if(!(uintptr_t(src) & 0b11)) {
+        const uint32_t *s = (const uint32_t *)src;
+        uint32_t *d = (uint32_t *)dest;
+        for(uint32_t i = 0; i < count / 2; i++) {
+          d[i] = lut_pair(s[i]);
+        }
+        src += count & ~1u;
+        dest += count & ~1u;
+        count &= 1;
+      }
+
+      while(count--) {
+        *dest++ = lut_pair(*src++);
+      }
+    }else if(_mode == MATRIX) {
+      for(uint32_t i = 0; i < count; i++) {
+        dest[i] = matrix_pixel(src[i]);
+      }
+    }else if(src != dest) {
+      memcpy(dest, src, count * sizeof(pen_t));
+    }
+  }
+
+  void post_process(buffer_t &b) {
+    if(_mode == OFF) return;
+
+    post_line(b.data, b.data, b.w * b.h);
+  }
+
+}
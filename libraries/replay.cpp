@@ -0,0 +1,108 @@
+#include <stdio.h>
+#include <cstdint>
+
+#include "replay.hpp"
+
+namespace picosystem {
+
+  namespace {
+    enum mode_t {IDLE, RECORDING, REPLAYING};
+
+    mode_t _mode = IDLE;
+    replay_t *_replay = nullptr;
+    replay_hash_t _on_hash = nullptr;
+    uint32_t _position = 0;
+    bool _fed = false;  // this frame's input came from the replay
+
+    void print_hash(uint32_t frame, uint32_t hash) {
+      printf("frame %lu %08lx\n", (unsigned long)frame, (unsigned long)hash);
+    }
+  }
+
+  void record(replay_t &r) {
+    r.count = 0;
+    _replay = &r;
+    _mode = RECORDING;
+  }
+
+  void replay(replay_t &r, replay_hash_t on_hash) {
+    _replay = &r;
+    _on_hash = on_hash ? on_hash : print_hash;
+    _position = 0;
+    _fed = false;
+    _mode = REPLAYING;
+  }
+
+  void stop_replay() {
+    _mode = IDLE;
+    _replay = nullptr;
+  }
+
+  bool is_recording() {
+    return _mode == RECORDING;
+  }
+
+  bool is_replaying() {
+    return _mode == REPLAYING;
+  }
+
+  uint32_t hash(const buffer_t &b) {
+    const uint32_t *p = (const uint32_t *)b.data;
+    uint32_t words = (b.w * b.h) / 2;
+
+    uint32_t h = 2166136261u;
+    for(uint32_t i = 0; i < words; i++) {
+      h = (h ^ p[i]) * 16777619u;
+    }
+
+    // odd pixel count
+    if((b.w * b.h) & 1) {
+      h = (h ^ b.data[b.w * b.h - 1]) * 16777619u;
+    }
+
+    return h;
+  }
+
+  void replay_frame(uint32_t &now, uint32_t &pending_ms, uint32_t &elapsed, uint32_t &buttons) {
+    if(_mode == RECORDING) {
+      replay_t &r = *_replay;
+      if(r.count == 0) {
+        r.start_ms = now;
+        r.start_pending_ms = pending_ms;
+      }
+
+      if(r.count < r.capacity) {
+        r.frames[r.count++] = {elapsed, buttons};
+      }
+
+      if(r.count == r.capacity) {
+        stop_replay();
+      }
+    }else if(_mode == REPLAYING) {
+      replay_t &r = *_replay;
+      if(_position == r.count) {
+        stop_replay();
+        return;
+      }
+
+      if(_position == 0) {
+        now = r.start_ms;
+        pending_ms = r.start_pending_ms;
+      }
+
+      elapsed = r.frames[_position].elapsed;
+      buttons = r.frames[_position].buttons;
+      _fed = true;
+    }
+  }
+
+  // a replay started from update() or render() has fed nothing yet this
+  // frame, its first hash is for the next one
+  void replay_rendered() {
+    if(_mode == REPLAYING && _fed) {
+      _fed = false;
+      _on_hash(_position++, hash(_screen.buffer));
+    }
+  }
+
+}
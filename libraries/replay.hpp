@@ -0,0 +1,51 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // input record and replay
+  //
+  // the main loop takes one snapshot of the buttons per frame and advances
+  // its clock by the time elapsed since the last frame. recording saves
+  // both so that replaying them later calls update() with exactly the same
+  // ticks and input, and so draws exactly the same frames (as long as the
+  // game reads input through pressed() and time through update()'s tick).
+  //
+  // while replaying a hash of the screen is reported after every render()
+  // so that a change in any pixel between two builds is easy to spot.
+  struct replay_frame_t {
+    uint32_t elapsed;   // ms since the previous frame
+    uint32_t buttons;   // pressed buttons, bit n is gpio n
+  };
+
+  struct replay_t {
+    replay_frame_t *frames;
+    uint32_t capacity;
+    uint32_t count;
+
+    // main loop clock when the recording started
+    uint32_t start_ms;
+    uint32_t start_pending_ms;
+  };
+
+  // called with the frame number and screen hash after each replayed frame,
+  // defaults to printing them to stdio (call stdio_init_all() in init())
+  using replay_hash_t = void (*)(uint32_t frame, uint32_t hash);
+
+  // recording stops by itself once the replay is full
+  void record(replay_t &r);
+  void replay(replay_t &r, replay_hash_t on_hash = nullptr);
+  void stop_replay();
+  bool is_recording();
+  bool is_replaying();
+
+  // fnv-1a over the buffer a word at a time
+  uint32_t hash(const buffer_t &b);
+
+  // main loop hooks. the clock (before elapsed is added) and input for the
+  // frame are either recorded or replaced with the recorded values
+  void replay_frame(uint32_t &now, uint32_t &pending_ms, uint32_t &elapsed, uint32_t &buttons);
+  void replay_rendered();
+
+}
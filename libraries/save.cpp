@@ -0,0 +1,430 @@
+#include <cstdint>
+#include <cstring>
+
+#include "save.hpp"
+
+namespace picosystem {
+
+  namespace {
+    constexpr uint32_t MAGIC   = 0x564b5350; // "PSKV"
+    constexpr uint32_t ERASED  = 0xffffffff;
+    constexpr uint32_t NONE    = 0xffffffff;
+    constexpr uint16_t VALUE   = 1;
+    constexpr uint16_t REMOVED = 2;
+    constexpr uint16_t COMMIT  = 3; // head's copy of the oldest sector is complete
+
+    struct sector_header_t {
+      uint32_t magic;
+      uint32_t sequence;
+    };
+
+    struct record_header_t {
+      uint32_t key;
+      uint16_t length;
+      uint16_t type;  // VALUE, REMOVED, or COMMIT, 0xffff if erased flash
+      uint32_t crc;   // of key, length, type, and data
+    };
+
+    struct index_t {
+      uint32_t key;
+      uint32_t offset;  // of the newest record in flash or NONE
+    };
+
+    constexpr uint32_t align4(uint32_t v) {
+      return (v + 3) & ~3u;
+    }
+
+    struct {
+      bool mounted = false;
+
+      uint32_t head;      // sector being appended to
+      uint32_t sequence;  // of the head sector
+      uint32_t write;     // offset of the next record
+
+      index_t index[PICOSYSTEM_SAVE_KEYS];
+      uint32_t keys = 0;
+
+      alignas(4) uint8_t pending[PICOSYSTEM_SAVE_BUFFER];
+      uint32_t pending_length = 0;
+      uint32_t pending_since = 0;
+      bool full = false;  // last flush didn't fit, wait for save_flush()
+      uint32_t rotations = 0; // made for the first pending record so far
+
+      // contents of the flash page currently being written
+      alignas(4) uint8_t page[SAVE_PAGE_SIZE];
+      uint32_t page_base = NONE;
+    } _save;
+
+    uint32_t record_crc(const record_header_t *r, const uint8_t *data) {
+      uint32_t crc = crc32(r, 8);
+      return crc32(data, r->length, crc);
+    }
+
+    index_t *find(uint32_t key) {
+      for(uint32_t i = 0; i < _save.keys; i++) {
+        if(_save.index[i].key == key) return &_save.index[i];
+      }
+
+      return nullptr;
+    }
+
+    index_t *find_or_add(uint32_t key) {
+      index_t *e = find(key);
+      if(!e && _save.keys < PICOSYSTEM_SAVE_KEYS) {
+        e = &_save.index[_save.keys++];
+        e->key = key;
+        e->offset = NONE;
+      }
+
+      return e;
+    }
+
+    void index_record(const record_header_t *r, uint32_t offset) {
+      if(r->type == COMMIT) return;
+
+      if(r->type == REMOVED) {
+        index_t *e = find(r->key);
+        if(e) *e = _save.index[--_save.keys];
+        return;
+      }
+
+      index_t *e = find_or_add(r->key);
+      if(e) e->offset = offset;
+    }
+
+    // program the page buffer (if in use) and start afresh. bytes already
+    // programmed are left as 0xff in the buffer so rewriting them is a no-op
+    void flush_page() {
+      if(_save.page_base != NONE) {
+        flash_program_page(_save.page_base, _save.page);
+        _save.page_base = NONE;
+      }
+    }
+
+    void append(const void *data, uint32_t length) {
+      const uint8_t *p = (const uint8_t *)data;
+      while(length) {
+        uint32_t base = _save.write & ~(SAVE_PAGE_SIZE - 1);
+        if(base != _save.page_base) {
+          flush_page();
+          _save.page_base = base;
+          memset(_save.page, 0xff, SAVE_PAGE_SIZE);
+        }
+
+        uint32_t o = _save.write - base;
+        uint32_t n = std::min(length, SAVE_PAGE_SIZE - o);
+        memcpy(_save.page + o, p, n);
+        p += n;
+        _save.write += n;
+        length -= n;
+      }
+    }
+
+    bool fits(uint32_t size) {
+      return _save.write + size <= (_save.head + 1) * SAVE_SECTOR_SIZE;
+    }
+
+    bool valid_sector(uint32_t sector) {
+      const sector_header_t *h = (const sector_header_t *)flash_data(sector * SAVE_SECTOR_SIZE);
+      return h->magic == MAGIC && _save.sequence - h->sequence < PICOSYSTEM_SAVE_SECTORS;
+    }
+
+    bool erased_sector(uint32_t sector) {
+      const uint32_t *p = (const uint32_t *)flash_data(sector * SAVE_SECTOR_SIZE);
+      for(uint32_t i = 0; i < SAVE_SECTOR_SIZE / 4; i++) {
+        if(p[i] != ERASED) return false;
+      }
+
+      return true;
+    }
+
+    // calls f(header, data, offset) for each intact record in a sector and
+    // returns the offset just past the last one
+    template<typename F>
+    uint32_t scan(uint32_t sector, F f) {
+      uint32_t offset = sector * SAVE_SECTOR_SIZE + sizeof(sector_header_t);
+      uint32_t end = (sector + 1) * SAVE_SECTOR_SIZE;
+
+      while(offset + sizeof(record_header_t) <= end) {
+        const record_header_t *r = (const record_header_t *)flash_data(offset);
+        const uint8_t *data = (const uint8_t *)(r + 1);
+
+        if(r->key == ERASED && r->type == 0xffff) {
+          return offset; // end of log
+        }
+
+        uint32_t size = sizeof(record_header_t) + align4(r->length);
+        if(r->length > SAVE_MAX_LENGTH || offset + size > end ||
+           (r->type != VALUE && r->type != REMOVED && r->type != COMMIT) ||
+           r->crc != record_crc(r, data)) {
+          return end; // torn write, don't append after it
+        }
+
+        f(r, data, offset);
+        offset += size;
+      }
+
+      return offset;
+    }
+
+    // copies the records in a sector that are still the newest for their
+    // key to the head, leaving room for the commit record. this always fits
+    // as the head has just been started.
+    void relocate(uint32_t sector) {
+      if(!valid_sector(sector)) return;
+
+      scan(sector, [](const record_header_t *r, const uint8_t *, uint32_t offset) {
+        index_t *e = find(r->key);
+        if(r->type == VALUE && e && e->offset == offset) {
+          uint32_t size = sizeof(record_header_t) + align4(r->length);
+          if(!fits(size + sizeof(record_header_t))) return;
+
+          e->offset = _save.write;
+          append(r, size);
+        }
+      });
+    }
+
+    void start_sector(uint32_t sector) {
+      _save.head = sector;
+      _save.write = sector * SAVE_SECTOR_SIZE;
+      sector_header_t h{MAGIC, _save.sequence};
+      append(&h, sizeof(h));
+    }
+
+    // marks the head as holding everything it needs from the oldest sector,
+    // which from then on may be erased
+    void commit() {
+      record_header_t r{0, 0, COMMIT, 0};
+      r.crc = record_crc(&r, nullptr);
+      append(&r, sizeof(r));
+      flush_page();
+    }
+
+    bool committed(uint32_t sector) {
+      bool found = false;
+      scan(sector, [&found](const record_header_t *r, const uint8_t *, uint32_t) {
+        if(r->type == COMMIT) found = true;
+      });
+      return found;
+    }
+
+    // move the head to the next (erased) sector, reclaim the oldest sector
+    // and erase it ready for next time
+    void rotate() {
+      flush_page();
+
+      _save.sequence++;
+      start_sector((_save.head + 1) % PICOSYSTEM_SAVE_SECTORS);
+
+      uint32_t oldest = (_save.head + 1) % PICOSYSTEM_SAVE_SECTORS;
+      relocate(oldest);
+      commit();
+      flash_erase_sector(oldest * SAVE_SECTOR_SIZE);
+    }
+
+    void mount() {
+      if(_save.mounted) return;
+      _save.mounted = true;
+
+      // the head is the valid sector with the newest sequence number
+      bool found = false;
+      for(uint32_t i = 0; i < PICOSYSTEM_SAVE_SECTORS; i++) {
+        const sector_header_t *h = (const sector_header_t *)flash_data(i * SAVE_SECTOR_SIZE);
+        if(h->magic == MAGIC && (!found || int32_t(h->sequence - _save.sequence) > 0)) {
+          found = true;
+          _save.head = i;
+          _save.sequence = h->sequence;
+        }
+      }
+
+      if(!found) {
+        // blank (or foreign) region, format the first two sectors
+        flash_erase_sector(0);
+        flash_erase_sector(SAVE_SECTOR_SIZE);
+        _save.sequence = 1;
+        start_sector(0);
+        commit();
+        return;
+      }
+
+      // the sector after the head should be erased. if it still holds
+      // records then a rotation was interrupted. with the head committed
+      // only the erase was cut short (and may have left the header intact)
+      // so the spare is finished off before it's read. otherwise the copies
+      // in the head may be torn so the head is started again.
+      uint32_t spare = (_save.head + 1) % PICOSYSTEM_SAVE_SECTORS;
+      bool redo = false;
+      if(!erased_sector(spare) && committed(_save.head)) {
+        flash_erase_sector(spare * SAVE_SECTOR_SIZE);
+      }else if(valid_sector(spare)) {
+        flash_erase_sector(_save.head * SAVE_SECTOR_SIZE);
+        start_sector(_save.head);
+        flush_page();
+        redo = true;
+      }
+
+      // rebuild the index from the oldest sector to the newest
+      for(uint32_t i = 1; i <= PICOSYSTEM_SAVE_SECTORS; i++) {
+        uint32_t sector = (_save.head + i) % PICOSYSTEM_SAVE_SECTORS;
+        if(!valid_sector(sector)) continue;
+
+        uint32_t end = scan(sector, [](const record_header_t *r, const uint8_t *, uint32_t offset) {
+          index_record(r, offset);
+        });
+
+        if(sector == _save.head) {
+          _save.write = end;
+        }
+      }
+
+      // finish off the interrupted rotation (or clear a torn erase)
+      if(redo) {
+        relocate(spare);
+        commit();
+      }
+
+      if(!erased_sector(spare)) {
+        flash_erase_sector(spare * SAVE_SECTOR_SIZE);
+      }
+    }
+
+    // finds the newest pending record for a key
+    const record_header_t *find_pending(uint32_t key) {
+      const record_header_t *found = nullptr;
+      uint32_t offset = 0;
+      while(offset < _save.pending_length) {
+        const record_header_t *r = (const record_header_t *)(_save.pending + offset);
+        if(r->key == key) found = r;
+        offset += sizeof(record_header_t) + align4(r->length);
+      }
+
+      return found;
+    }
+
+    bool write_record(uint32_t key, uint16_t type, const void *data, uint32_t length) {
+      mount();
+
+      uint32_t size = sizeof(record_header_t) + align4(length);
+      if(length > SAVE_MAX_LENGTH || _save.pending_length + size > PICOSYSTEM_SAVE_BUFFER) {
+        return false;
+      }
+
+      // reserve a slot in the index now so that the flush can't run out
+      if(type == VALUE && !find_or_add(key)) {
+        return false;
+      }
+
+      record_header_t *r = (record_header_t *)(_save.pending + _save.pending_length);
+      r->key = key;
+      r->length = length;
+      r->type = type;
+      memset(r + 1, 0, align4(length));
+      if(length) memcpy(r + 1, data, length);
+      r->crc = record_crc(r, (const uint8_t *)(r + 1));
+
+      if(!_save.pending_length) {
+        _save.pending_since = time();
+      }
+      _save.pending_length += size;
+      _save.full = false;
+      _save.rotations = 0;
+
+      return true;
+    }
+
+    enum flush_t {FLUSHED, PAUSED, FULL};
+
+    // writes pending records until they're all written or the next one
+    // needs more than the given number of rotations. what isn't written
+    // stays buffered.
+    flush_t write_pending(uint32_t rotations) {
+      mount();
+
+      flush_t result = FLUSHED;
+      uint32_t offset = 0;
+      while(offset < _save.pending_length) {
+        const record_header_t *r = (const record_header_t *)(_save.pending + offset);
+        uint32_t size = sizeof(record_header_t) + align4(r->length);
+
+        if(!fits(size)) {
+          // each rotation compacts the oldest sector into the new head which
+          // can leave it as full as before, once every sector has been
+          // compacted the live values simply don't leave room
+          if(_save.rotations == PICOSYSTEM_SAVE_SECTORS - 1) {
+            result = FULL;
+            break;
+          }
+          if(!rotations) {
+            result = PAUSED;
+            break;
+          }
+
+          rotate();
+          rotations--;
+          _save.rotations++;
+          continue;
+        }
+
+        index_record(r, _save.write);
+        append(r, size);
+        offset += size;
+        _save.rotations = 0;
+      }
+
+      flush_page();
+
+      _save.pending_length -= offset;
+      memmove(_save.pending, _save.pending + offset, _save.pending_length);
+      _save.full = result == FULL;
+      return result;
+    }
+  }
+
+  bool save_write(uint32_t key, const void *data, uint32_t length) {
+    return write_record(key, VALUE, data, length);
+  }
+
+  bool save_remove(uint32_t key) {
+    return write_record(key, REMOVED, nullptr, 0);
+  }
+
+  int32_t save_read(uint32_t key, void *data, uint32_t max) {
+    mount();
+
+    const record_header_t *r = find_pending(key);
+    if(!r) {
+      index_t *e = find(key);
+      if(!e || e->offset == NONE) return -1;
+      r = (const record_header_t *)flash_data(e->offset);
+    }
+
+    if(r->type == REMOVED) return -1;
+
+    memcpy(data, r + 1, std::min<uint32_t>(r->length, max));
+    return r->length;
+  }
+
+  bool save_flush() {
+    _save.rotations = 0;
+    return write_pending(UINT32_MAX) == FLUSHED;
+  }
+
+  uint32_t save_pending() {
+    return _save.pending_length;
+  }
+
+  bool save_service() {
+    if(!_save.pending_length || _save.full) return false;
+
+    if(time() - _save.pending_since < PICOSYSTEM_SAVE_FLUSH_MS &&
+       _save.pending_length < PICOSYSTEM_SAVE_BUFFER / 2) {
+      return false;
+    }
+
+    // at most one erase per call, the rest waits for the next frame
+    write_pending(1);
+    return true;
+  }
+
+}
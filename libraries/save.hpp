@@ -0,0 +1,78 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // persistent key-value store
+  //
+  // values are appended as records to a log kept in a ring of sectors at the
+  // end of flash, the newest record for a key wins. when the head sector is
+  // full the log moves on to the next (already erased) sector, copies any
+  // still live records out of the oldest sector, and erases it. every sector
+  // is erased in turn so wear is spread evenly across the region.
+  //
+  // records carry a crc so a write torn by power loss is ignored at startup,
+  // and the oldest sector is only erased once its live records have been
+  // copied and the copy committed, so an interrupted rotation is picked up
+  // again on the next boot.
+  //
+  // writes are buffered in ram and only reach flash in save_flush(). flash
+  // operations stall the cpu (an erase takes tens of milliseconds) so the
+  // main loop calls save_service() only while the screen dma is running,
+  // which reads from ram and so carries on regardless, and at most once a
+  // frame.
+  #ifndef PICOSYSTEM_SAVE_SECTORS
+  #define PICOSYSTEM_SAVE_SECTORS 8
+  #endif
+
+  #ifndef PICOSYSTEM_SAVE_KEYS
+  #define PICOSYSTEM_SAVE_KEYS 64
+  #endif
+
+  #ifndef PICOSYSTEM_SAVE_BUFFER
+  #define PICOSYSTEM_SAVE_BUFFER 1024
+  #endif
+
+  // pending writes are flushed once they are this old (or the buffer is
+  // half full) so that bursts of small writes are coalesced
+  #ifndef PICOSYSTEM_SAVE_FLUSH_MS
+  #define PICOSYSTEM_SAVE_FLUSH_MS 500
+  #endif
+
+  constexpr uint32_t SAVE_SECTOR_SIZE = 4096;
+  constexpr uint32_t SAVE_PAGE_SIZE   = 256;
+  constexpr uint32_t SAVE_REGION_SIZE = PICOSYSTEM_SAVE_SECTORS * SAVE_SECTOR_SIZE;
+
+  // largest value that can be stored, records have a 12 byte header
+  constexpr uint32_t SAVE_MAX_LENGTH  = std::min<uint32_t>(PICOSYSTEM_SAVE_BUFFER, SAVE_SECTOR_SIZE - 8) - 12;
+
+  // returns false if the value is too large or the write buffer or key
+  // table is full (call save_flush() and try again)
+  bool save_write(uint32_t key, const void *data, uint32_t length);
+
+  // copies up to max bytes of a value into data and returns its length,
+  // or -1 if there is no value for the key
+  int32_t save_read(uint32_t key, void *data, uint32_t max);
+
+  bool save_remove(uint32_t key);
+
+  // writes all buffered records to flash now. returns false if the values
+  // already saved leave no room, what didn't fit stays buffered (and isn't
+  // retried by save_service()) until values are removed and it's flushed
+  // again.
+  bool save_flush();
+  uint32_t save_pending();
+
+  // flushes if the flush policy says it's due, returns true if any flash
+  // work was done. at most one sector is erased per call, records that
+  // need another rotation stay buffered until the next call.
+  bool save_service();
+
+  // flash access, implemented by the hal. offsets are relative to the
+  // start of the save region.
+  const uint8_t *flash_data(uint32_t offset);
+  void flash_erase_sector(uint32_t offset);
+  void flash_program_page(uint32_t offset, const uint8_t *data);
+
+}
@@ -0,0 +1,145 @@
+#include <cstdint>
+
+#include "task.hpp"
+
+namespace picosystem {
+
+  namespace {
+    struct frame_block_t {
+      alignas(8) uint8_t data[PICOSYSTEM_TASK_FRAME_SIZE];
+    };
+
+    pool_t<frame_block_t, PICOSYSTEM_TASK_FRAMES> _task_frames;
+
+    struct slot_t {
+      task_t::handle_t root;
+      bool background;
+    };
+
+    slot_t _tasks[PICOSYSTEM_TASKS];
+    uint32_t _task_count = 0;
+
+    uint32_t _task_now = 0;
+    uint32_t _task_frame = 0;
+    uint32_t _background_us = 0; // background work done this frame
+    uint32_t _next_background = 0;
+
+    bool due(const task_t::promise_type &p) {
+      return int32_t(_task_now - p.wake_ms) >= 0 && int32_t(_task_frame - p.wake_frame) >= 0;
+    }
+
+    // resumes the innermost task of slot i, removing it if it completed or
+    // failed. returns false if the slot was removed.
+    bool resume(uint32_t i) {
+      task_t::handle_t root = _tasks[i].root;
+      task_t::handle_t::from_promise(*root.promise().current).resume();
+      if(!root.done() && !root.promise().failed) return true;
+
+      root.destroy();
+      _task_count--;
+      for(uint32_t j = i; j < _task_count; j++) {
+        _tasks[j] = _tasks[j + 1];
+      }
+      return false;
+    }
+  }
+
+  void *task_t::promise_type::operator new(size_t size) noexcept {
+    if(size > sizeof(frame_block_t)) return nullptr;
+    return _task_frames.alloc();
+  }
+
+  void task_t::promise_type::operator delete(void *p) noexcept {
+    _task_frames.free(static_cast<frame_block_t *>(p));
+  }
+
+  std::coroutine_handle<> task_t::final_awaiter_t::await_suspend(handle_t h) noexcept {
+    // hand control back to the task that awaited this one, a root task
+    // just stays suspended until the scheduler sees it is done
+    promise_type &p = h.promise();
+    if(!p.continuation) return std::noop_coroutine();
+
+    p.root->current = &handle_t::from_address(p.continuation.address()).promise();
+    return p.continuation;
+  }
+
+  std::coroutine_handle<> task_t::awaiter_t::await_suspend(handle_t parent) {
+    // the child couldn't be allocated, the parent stays suspended and the
+    // scheduler ends the chain (destroying the root destroys the rest)
+    if(!child) {
+      parent.promise().root->failed = true;
+      return std::noop_coroutine();
+    }
+
+    promise_type &c = child.promise();
+    c.root = parent.promise().root;
+    c.continuation = parent;
+    c.root->current = &c;
+    return child;
+  }
+
+  void next_frame::await_suspend(task_t::handle_t h) {
+    h.promise().root->wake_frame = _task_frame + 1;
+  }
+
+  void delay::await_suspend(task_t::handle_t h) {
+    task_t::promise_type *root = h.promise().root;
+    root->wake_ms = _task_now + ms;
+    root->wake_frame = _task_frame + 1;
+  }
+
+  void next_slice::await_suspend(task_t::handle_t) {
+  }
+
+  bool spawn(task_t &&t, bool background) {
+    if(!t || _task_count == PICOSYSTEM_TASKS) return false;
+
+    // first resumed on the next call to tasks_frame() or tasks_background()
+    t.handle.promise().wake_ms = _task_now;
+    t.handle.promise().wake_frame = _task_frame;
+    _tasks[_task_count++] = {t.handle, background};
+    t.handle = nullptr;
+    return true;
+  }
+
+  uint32_t task_count() {
+    return _task_count;
+  }
+
+  void tasks_frame(uint32_t now) {
+    _task_now = now;
+    _task_frame++;
+    _background_us = 0;
+
+    // tasks spawned during the loop wait for the next frame
+    uint32_t count = _task_count;
+    for(uint32_t i = 0; i < count && i < _task_count; ) {
+      if(!_tasks[i].background && due(_tasks[i].root.promise())) {
+        if(!resume(i)) {
+          count--;
+          continue;
+        }
+      }
+      i++;
+    }
+  }
+
+  bool tasks_background() {
+    if(_background_us >= PICOSYSTEM_TASK_BUDGET_US) return false;
+
+    // round robin from where we left off so one busy task can't starve
+    // the others
+    for(uint32_t n = 0; n < _task_count; n++) {
+      uint32_t i = (_next_background + n) % _task_count;
+      if(!_tasks[i].background || !due(_tasks[i].root.promise())) continue;
+
+      uint32_t start_us = time_us();
+      _next_background = resume(i) ? i + 1 : i;
+      _background_us += time_us() - start_us;
+      return true;
+    }
+
+    return false;
+  }
+
+}
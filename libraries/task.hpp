@@ -0,0 +1,136 @@
+#pragma once
+
+#include <coroutine>
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // tasks
+  //
+  // stackless coroutines run alongside the frame loop so that scripts can
+  // be written as straight line code, e.g.
+  //
+  //   task_t intro() {
+  //     co_await walk_to(40, 100);     // tasks can await other tasks
+  //     co_await delay(500);
+  //     while(!pressed(A)) co_await next_frame();
+  //   }
+  //
+  //   void init() { spawn(intro()); }
+  //
+  // frame tasks are resumed once per frame after update(), using the same
+  // clock as update() so they replay deterministically. background tasks
+  // are resumed while the main loop waits for the previous frame to reach
+  // the screen, until PICOSYSTEM_TASK_BUDGET_US of work has been done that
+  // frame. they should co_await next_slice() often since a slice that runs
+  // past the end of the flip delays render().
+  //
+  // coroutine frames come from a fixed pool rather than the heap. a task
+  // whose frame is too large for a block (or when the pool is empty) is
+  // returned empty and spawn() refuses it. awaiting an empty task fails the
+  // task that awaited it, the whole chain up to the spawned task is ended
+  // rather than carrying on with a step missing.
+  #ifndef PICOSYSTEM_TASKS
+  #define PICOSYSTEM_TASKS 16
+  #endif
+
+  #ifndef PICOSYSTEM_TASK_FRAMES
+  #define PICOSYSTEM_TASK_FRAMES 32
+  #endif
+
+  #ifndef PICOSYSTEM_TASK_FRAME_SIZE
+  #define PICOSYSTEM_TASK_FRAME_SIZE 256
+  #endif
+
+  #ifndef PICOSYSTEM_TASK_BUDGET_US
+  #define PICOSYSTEM_TASK_BUDGET_US 4000
+  #endif
+
+  struct task_t {
+    struct promise_type;
+    using handle_t = std::coroutine_handle<promise_type>;
+
+    struct final_awaiter_t {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(handle_t h) noexcept;
+      void await_resume() noexcept {}
+    };
+
+    struct promise_type {
+      promise_type *root = this;    // outermost task, holds the wait state
+      promise_type *current = this; // innermost task of a chain (root only)
+      std::coroutine_handle<> continuation; // task awaiting this one
+
+      uint32_t wake_ms = 0;
+      uint32_t wake_frame = 0;
+      bool failed = false;  // (root only) awaited an empty task
+
+      static void *operator new(size_t size) noexcept;
+      static void operator delete(void *p) noexcept;
+      static task_t get_return_object_on_allocation_failure() { return task_t(); }
+
+      task_t get_return_object() { return task_t(handle_t::from_promise(*this)); }
+      std::suspend_always initial_suspend() noexcept { return {}; }
+      final_awaiter_t final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() {}
+    };
+
+    handle_t handle;
+
+    task_t() : handle(nullptr) {}
+    explicit task_t(handle_t h) : handle(h) {}
+    task_t(task_t &&t) : handle(t.handle) { t.handle = nullptr; }
+    task_t(const task_t &) = delete;
+    task_t &operator=(const task_t &) = delete;
+    ~task_t() { if(handle) handle.destroy(); }
+
+    explicit operator bool() const { return bool(handle); }
+
+    // awaiting a task runs it to completion as part of the caller
+    struct awaiter_t {
+      handle_t child;
+      bool await_ready() { return false; }
+      std::coroutine_handle<> await_suspend(handle_t parent);
+      void await_resume() {}
+    };
+
+    awaiter_t operator co_await() && { return {handle}; }
+  };
+
+  struct next_frame {
+    bool await_ready() { return false; }
+    void await_suspend(task_t::handle_t h);
+    void await_resume() {}
+  };
+
+  struct delay {
+    uint32_t ms;
+    explicit delay(uint32_t ms) : ms(ms) {}
+    bool await_ready() { return false; }
+    void await_suspend(task_t::handle_t h);
+    void await_resume() {}
+  };
+
+  // lets the scheduler decide whether to carry on this frame, in a frame
+  // task it is the same as next_frame
+  struct next_slice {
+    bool await_ready() { return false; }
+    void await_suspend(task_t::handle_t h);
+    void await_resume() {}
+  };
+
+  // hands the task to the scheduler, which destroys it once it finishes.
+  // returns false if the task is empty or all PICOSYSTEM_TASKS are in use.
+  bool spawn(task_t &&t, bool background = false);
+  uint32_t task_count();
+
+  // called by the main loop. tasks_frame() advances the task clock and
+  // resumes the frame tasks that are due, tasks_background() runs one
+  // slice of background work and returns false if there was none to do
+  // (or the budget for this frame is spent).
+  void tasks_frame(uint32_t now);
+  bool tasks_background();
+
+}
@@ -0,0 +1,210 @@
+#include <cstdint>
+
+#include "tween.hpp"
+
+namespace picosystem {
+
+  namespace {
+    // just enough maths for the compiler to sample the curves with
+    constexpr double PI = 3.14159265358979323846;
+
+    constexpr double const_sin(double x) {
+      while(x > PI) x -= 2 * PI;
+      while(x < -PI) x += 2 * PI;
+      double term = x, sum = x;
+      for(int i = 1; i < 12; i++) {
+        term *= -x * x / ((2 * i) * (2 * i + 1));
+        sum += term;
+      }
+      return sum;
+    }
+
+    constexpr double const_exp2(double x) {
+      // 2^x for the non-positive x the elastic curves use, halved until
+      // small enough for a short series and then squared back up
+      int halvings = 0;
+      while(x < -0.5) { x /= 2; halvings++; }
+      double y = x * 0.6931471805599453, term = 1, sum = 1;
+      for(int i = 1; i < 16; i++) {
+        term *= y / i;
+        sum += term;
+      }
+      while(halvings--) sum *= sum;
+      return sum;
+    }
+
+    constexpr double bounce_out(double t) {
+      constexpr double n = 7.5625, d = 2.75;
+      if(t < 1 / d)   return n * t * t;
+      if(t < 2 / d)   { t -= 1.5 / d;   return n * t * t + 0.75; }
+      if(t < 2.5 / d) { t -= 2.25 / d;  return n * t * t + 0.9375; }
+      t -= 2.625 / d;
+      return n * t * t + 0.984375;
+    }
+
+    constexpr double curve(uint32_t e, double t) {
+      constexpr double c = 2 * PI / 3;
+      double u = 1 - t;
+      switch(e) {
+        case QUAD_IN:      return t * t;
+        case QUAD_OUT:     return 1 - u * u;
+        case QUAD_IN_OUT:  return t < 0.5 ? 2 * t * t : 1 - 2 * u * u;
+        case CUBIC_IN:     return t * t * t;
+        case CUBIC_OUT:    return 1 - u * u * u;
+        case CUBIC_IN_OUT: return t < 0.5 ? 4 * t * t * t : 1 - 4 * u * u * u;
+        case ELASTIC_IN:
+          return t <= 0 || t >= 1 ? t : -const_exp2(10 * t - 10) * const_sin((t * 10 - 10.75) * c);
+        case ELASTIC_OUT:
+          return t <= 0 || t >= 1 ? t : const_exp2(-10 * t) * const_sin((t * 10 - 0.75) * c) + 1;
+        case BOUNCE_IN:    return 1 - bounce_out(u);
+        case BOUNCE_OUT:   return bounce_out(t);
+        default:           return t;
+      }
+    }
+
+    // 256 steps per curve plus the end point, in 2.14 fixed point
+    constexpr int32_t EASE_ONE = 1 << 14;
+
+    struct ease_tables_t {
+      int16_t v[EASE_COUNT][257];
+      constexpr ease_tables_t() : v() {
+        for(uint32_t e = 0; e < EASE_COUNT; e++) {
+          for(uint32_t i = 0; i <= 256; i++) {
+            double s = curve(e, i / 256.0) * EASE_ONE;
+            v[e][i] = int16_t(s < 0 ? s - 0.5 : s + 0.5);
+          }
+        }
+      }
+    };
+
+    constexpr ease_tables_t EASE;
+
+    constexpr uint32_t TWEEN_END = 1 << 24;
+
+    // eased position for progress in 8.16, in 2.14
+    inline int32_t sample(ease_t e, uint32_t progress) {
+      const int16_t *v = EASE.v[e];
+      uint32_t i = progress >> 16, f = progress & 0xffff;
+      int32_t s = v[i];
+      if(f) s += ((v[i + 1] - s) * int32_t(f)) >> 16;
+      return s;
+    }
+
+    inline int32_t tween_value(const tween_t &t) {
+      return t.from + int32_t((int64_t(t.to) - t.from) * sample(t.ease, t.progress) >> 14);
+    }
+  }
+
+  fixed_t ease(ease_t e, fixed_t t) {
+    t = std::clamp<fixed_t>(t, 0, FIXED_ONE);
+    return sample(e, uint32_t(t) << 8) << 2;
+  }
+
+  bool tween(tweens_t &t, int32_t *value, int32_t to, uint32_t ms, ease_t e, uint8_t flags) {
+    tween_t *w = nullptr;
+    for(uint32_t i = 0; i < t.count; i++) {
+      if(t.items[i].value == value) {
+        w = &t.items[i];
+        break;
+      }
+    }
+
+    if(!w) {
+      if(t.count == t.capacity) return false;
+      w = &t.items[t.count++];
+    }
+
+    // rounded up so the tween ends on the update that reaches ms, not after
+    ms = std::max<uint32_t>(ms, 1);
+    *w = {value, *value, to, 0, (TWEEN_END + ms - 1) / ms, e, flags};
+    return true;
+  }
+
+  void tween_update(tweens_t &t, uint32_t ms) {
+    for(uint32_t i = 0; i < t.count; ) {
+      tween_t &w = t.items[i];
+
+      uint64_t progress = w.progress + uint64_t(w.rate) * ms;
+      if(progress >= TWEEN_END) {
+        if(w.flags & (TWEEN_LOOP | TWEEN_YOYO)) {
+          if(w.flags & TWEEN_YOYO) std::swap(w.from, w.to);
+          progress %= TWEEN_END;
+        }else{
+          // done, land exactly on the target and drop the tween
+          *w.value = w.to;
+          w = t.items[--t.count];
+          continue;
+        }
+      }
+
+      w.progress = uint32_t(progress);
+      *w.value = tween_value(w);
+      i++;
+    }
+  }
+
+  void tween_cancel(tweens_t &t, int32_t *value) {
+    for(uint32_t i = 0; i < t.count; i++) {
+      if(t.items[i].value == value) {
+        t.items[i] = t.items[--t.count];
+        return;
+      }
+    }
+  }
+
+  bool tweening(const tweens_t &t, const int32_t *value) {
+    for(uint32_t i = 0; i < t.count; i++) {
+      if(t.items[i].value == value) return true;
+    }
+    return false;
+  }
+
+  void play(animator_t &a, const animation_t &animation) {
+    a = {&animation, 0, 0, 1, false};
+  }
+
+  void animate(animator_t *a, uint32_t count, uint32_t ms) {
+    for(uint32_t i = 0; i < count; i++) {
+      animator_t &s = a[i];
+      const animation_t *n = s.animation;
+      if(!n || s.done || n->count < 2 || !n->frame_ms) continue;
+
+      uint32_t elapsed = s.elapsed + ms;
+      while(elapsed >= n->frame_ms && !s.done) {
+        elapsed -= n->frame_ms;
+
+        int32_t next = s.index + s.direction;
+        if(next < 0 || next >= n->count) {
+          if(n->mode == ANIMATION_ONCE) {
+            s.done = true;
+            elapsed = 0;
+            break;
+          }
+
+          if(n->mode == ANIMATION_PINGPONG) {
+            s.direction = -s.direction;
+            next = s.index + s.direction;
+          }else{
+            next = 0;
+          }
+        }
+
+        s.index = next;
+      }
+
+      s.elapsed = elapsed;
+    }
+  }
+
+  uint16_t current_frame(const animator_t &a) {
+    return a.animation && a.animation->count ? a.animation->frames[a.index] : 0;
+  }
+
+  void blit_frame(const buffer_t &sheet, int32_t fw, int32_t fh, uint16_t frame, int32_t x, int32_t y) {
+    int32_t columns = fw > 0 ? int32_t(sheet.w) / fw : 0;
+    if(!columns) return;
+
+    blit(sheet, (frame % columns) * fw, (frame / columns) * fh, fw, fh, x, y);
+  }
+
+}
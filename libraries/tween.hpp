@@ -0,0 +1,95 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // easing curves are sampled into tables by the compiler so evaluating
+  // one is a lookup and a lerp. ease() takes and returns 16.16 fixed point,
+  // the elastic curves overshoot past 0 and 1.
+  enum ease_t : uint8_t {
+    LINEAR,
+    QUAD_IN, QUAD_OUT, QUAD_IN_OUT,
+    CUBIC_IN, CUBIC_OUT, CUBIC_IN_OUT,
+    ELASTIC_IN, ELASTIC_OUT,
+    BOUNCE_IN, BOUNCE_OUT,
+    EASE_COUNT
+  };
+
+  fixed_t ease(ease_t e, fixed_t t);
+
+  // tweens
+  //
+  // each tween moves an int32_t (a plain value or a fixed_t) from where it
+  // was when the tween started to a target and writes it back every
+  // update. they live in a fixed capacity list which is updated as a batch
+  // and finished tweens are removed (which doesn't preserve order).
+  enum : uint8_t {
+    TWEEN_LOOP = 1 << 0,  // start again from the beginning
+    TWEEN_YOYO = 1 << 1   // run back and forth
+  };
+
+  struct tween_t {
+    int32_t *value;
+    int32_t from, to;
+    uint32_t progress;  // 1 << 24 is the end
+    uint32_t rate;      // progress per millisecond
+    ease_t ease;
+    uint8_t flags;
+  };
+
+  struct tweens_t {
+    uint32_t count;
+    uint32_t capacity;
+    tween_t *items;
+  };
+
+  // tweens_t with storage for N tweens
+  template<uint32_t N>
+  struct tween_storage_t : tweens_t {
+    tween_t storage[N];
+    tween_storage_t() : tweens_t{0, N, storage} {}
+  };
+
+  // starts a tween of value towards to, replacing any tween already on
+  // that value. returns false if the list is full.
+  bool tween(tweens_t &t, int32_t *value, int32_t to, uint32_t ms,
+             ease_t e = LINEAR, uint8_t flags = 0);
+  void tween_update(tweens_t &t, uint32_t ms);
+  void tween_cancel(tweens_t &t, int32_t *value);
+  bool tweening(const tweens_t &t, const int32_t *value);
+
+  // sprite animation
+  //
+  // an animation is a sequence of frames in a spritesheet shared by any
+  // number of animators, each of which tracks its own position in it.
+  enum animation_mode_t : uint8_t {
+    ANIMATION_LOOP,
+    ANIMATION_ONCE,     // stops on the last frame
+    ANIMATION_PINGPONG  // forwards then backwards
+  };
+
+  struct animation_t {
+    const uint16_t *frames; // frame indices in the spritesheet
+    uint16_t count;
+    uint16_t frame_ms;
+    animation_mode_t mode;
+  };
+
+  struct animator_t {
+    const animation_t *animation;
+    uint16_t elapsed;   // ms into the current frame
+    uint16_t index;     // position in the animation
+    int8_t direction;
+    bool done;
+  };
+
+  void play(animator_t &a, const animation_t &animation);
+  void animate(animator_t *a, uint32_t count, uint32_t ms);
+  uint16_t current_frame(const animator_t &a);
+
+  // blits frame from a spritesheet of fw x fh frames laid out left to
+  // right and top to bottom
+  void blit_frame(const buffer_t &sheet, int32_t fw, int32_t fh, uint16_t frame, int32_t x, int32_t y);
+
+}
@@ -0,0 +1,281 @@
+#include <cstdint>
+#include <cstring>
+
+#include "ui.hpp"
+#include "colour.hpp"
+
+namespace picosystem {
+
+  namespace {
+    enum : uint8_t {
+      DIRTY      = 1 << 0, // widget needs drawing
+      DESCENDANT = 1 << 1, // something inside the widget needs drawing
+      MEASURE    = 1 << 2  // preferred size is out of date
+    };
+
+    constexpr pen_t DEFAULT_FG     = pen_from_rgb888(255, 255, 255);
+    constexpr pen_t DEFAULT_BG     = pen_from_rgb888(32, 36, 48);
+    constexpr pen_t DEFAULT_ACCENT = pen_from_rgb888(48, 96, 192);
+
+    widget_t create_widget(widget_kind_t kind) {
+      widget_t w{};
+      w.kind = kind;
+      w.flags = DIRTY | MEASURE;
+      w.padding = 2;
+      w.spacing = 1;
+      w.fg = DEFAULT_FG;
+      w.bg = DEFAULT_BG;
+      w.accent = DEFAULT_ACCENT;
+      return w;
+    }
+
+    int32_t line_height() {
+      return _font ? _font->height : 8;
+    }
+
+    void mark_dirty(widget_t &w) {
+      w.flags |= DIRTY;
+      for(widget_t *p = w.parent; p && !(p->flags & DESCENDANT); p = p->parent) {
+        p->flags |= DESCENDANT;
+      }
+    }
+
+    // widgets start out flagged so the walk up starts from the parent, a
+    // flagged parent means everything above it already is
+    void mark_measure(widget_t &w) {
+      w.flags |= MEASURE;
+      for(widget_t *p = w.parent; p && !(p->flags & MEASURE); p = p->parent) {
+        p->flags |= MEASURE;
+      }
+    }
+
+    // bottom up, only revisits widgets whose size may have changed
+    void measure_widget(widget_t &w) {
+      if(!(w.flags & MEASURE)) return;
+      w.flags &= ~MEASURE;
+
+      int32_t pad = w.padding * 2;
+      switch(w.kind) {
+        case LABEL: {
+          w.pw = measure(std::string_view(w.text, w.text_length)) + pad;
+          w.ph = line_height() + pad;
+        } break;
+
+        case LIST: {
+          int32_t widest = 0;
+          for(uint16_t i = 0; i < w.item_count; i++) {
+            widest = std::max(widest, measure(w.items[i]));
+          }
+          w.pw = widest + pad;
+          w.ph = w.item_count * line_height() + pad;
+        } break;
+
+        case PROGRESS: {
+          w.pw = pad;
+          w.ph = pad;
+        } break;
+
+        case PANEL: {
+          int32_t widest = 0, height = 0;
+          for(widget_t *c = w.first; c; c = c->next) {
+            measure_widget(*c);
+            widest = std::max(widest, c->pw);
+            height += c->ph + (c->next ? w.spacing : 0);
+          }
+          w.pw = widest + pad;
+          w.ph = height + pad;
+        } break;
+      }
+
+      if(w.fixed_w) w.pw = w.fixed_w;
+      if(w.fixed_h) w.ph = w.fixed_h;
+    }
+
+    // top down, anything that moves or changes size is redrawn. a panel
+    // whose children moved is redrawn as a whole to clear where they were.
+    bool arrange(widget_t &w, int32_t x, int32_t y, int32_t width, int32_t height) {
+      bool changed = w.x != x || w.y != y || w.w != width || w.h != height;
+      w.x = x; w.y = y; w.w = width; w.h = height;
+
+      if(w.kind == PANEL) {
+        bool moved = false;
+        int32_t cy = y + w.padding;
+        for(widget_t *c = w.first; c; c = c->next) {
+          moved |= arrange(*c, x + w.padding, cy, width - w.padding * 2, c->ph);
+          cy += c->ph + w.spacing;
+        }
+        changed |= moved;
+      }
+
+      if(changed) mark_dirty(w);
+      return changed;
+    }
+
+    void paint(const widget_t &w) {
+      pen(w.bg);
+      rectangle(w.x, w.y, w.w, w.h);
+
+      int32_t ix = w.x + w.padding, iy = w.y + w.padding;
+      int32_t iw = w.w - w.padding * 2;
+      switch(w.kind) {
+        case LABEL: {
+          pen(w.fg);
+          text(std::string_view(w.text, w.text_length), ix, iy);
+        } break;
+
+        case LIST: {
+          int32_t lh = line_height();
+          for(uint16_t i = 0; i < w.item_count; i++) {
+            if(i == w.selected) {
+              pen(w.accent);
+              rectangle(w.x, iy + i * lh, w.w, lh);
+            }
+            pen(w.fg);
+            text(w.items[i], ix, iy + i * lh);
+          }
+        } break;
+
+        case PROGRESS: {
+          if(w.max > 0) {
+            int32_t v = std::clamp<int32_t>(w.value, 0, w.max);
+            pen(w.accent);
+            rectangle(ix, iy, int32_t(int64_t(iw) * v / w.max), w.h - w.padding * 2);
+          }
+        } break;
+
+        case PANEL:
+          break;
+      }
+    }
+
+    uint32_t draw_tree(widget_t &w, bool force) {
+      uint32_t drawn = 0;
+      bool self = force || (w.flags & DIRTY);
+
+      if(self) {
+        push_clip(w.x, w.y, w.w, w.h);
+        paint(w);
+        pop_clip();
+        drawn++;
+      }
+
+      // a redrawn widget has painted over its children so they all follow
+      if(w.first && (self || (w.flags & DESCENDANT))) {
+        push_clip(w.x, w.y, w.w, w.h);
+        for(widget_t *c = w.first; c; c = c->next) {
+          drawn += draw_tree(*c, self);
+        }
+        pop_clip();
+      }
+
+      w.flags &= ~(DIRTY | DESCENDANT);
+      return drawn;
+    }
+  }
+
+  widget_t create_panel(int32_t x, int32_t y, int32_t w, int32_t h) {
+    widget_t p = create_widget(PANEL);
+    p.x = x; p.y = y;
+    p.fixed_w = w; p.fixed_h = h;
+    return p;
+  }
+
+  widget_t create_label(std::string_view text) {
+    widget_t l = create_widget(LABEL);
+    ui_text(l, text);
+    return l;
+  }
+
+  widget_t create_list(const std::string_view *items, uint16_t count, int16_t selected) {
+    widget_t l = create_widget(LIST);
+    l.items = items;
+    l.item_count = count;
+    l.selected = selected;
+    return l;
+  }
+
+  widget_t create_progress(int32_t value, int32_t max, int32_t h) {
+    widget_t p = create_widget(PROGRESS);
+    p.value = value;
+    p.max = max;
+    p.fixed_h = h;
+    return p;
+  }
+
+  void ui_add(widget_t &parent, widget_t &child) {
+    child.parent = &parent;
+    child.next = nullptr;
+
+    widget_t **link = &parent.first;
+    while(*link) link = &(*link)->next;
+    *link = &child;
+
+    mark_measure(child);
+    mark_dirty(child);
+  }
+
+  void ui_invalidate(widget_t &w) {
+    mark_measure(w);
+    mark_dirty(w);
+  }
+
+  void ui_relayout(widget_t &w) {
+    // sizes inside the widget may depend on it too
+    for(widget_t *c = w.first; c; c = c->next) {
+      ui_relayout(*c);
+    }
+    mark_measure(w);
+    mark_dirty(w);
+  }
+
+  void ui_text(widget_t &w, std::string_view text) {
+    // truncate to fit without splitting a utf-8 sequence
+    uint32_t length = std::min<uint32_t>(text.length(), PICOSYSTEM_UI_TEXT);
+    if(length < text.length()) {
+      while(length && (uint8_t(text[length]) & 0xc0) == 0x80) length--;
+    }
+
+    if(length == w.text_length && !memcmp(w.text, text.data(), length)) return;
+
+    memcpy(w.text, text.data(), length);
+    w.text_length = length;
+    mark_measure(w);
+    mark_dirty(w);
+  }
+
+  void ui_value(widget_t &w, int32_t value) {
+    if(w.value == value) return;
+    w.value = value;
+    mark_dirty(w);
+  }
+
+  void ui_select(widget_t &w, int16_t index) {
+    if(w.selected == index) return;
+    w.selected = index;
+    mark_dirty(w);
+  }
+
+  uint32_t ui_draw(widget_t &root) {
+    if(root.flags & MEASURE) {
+      measure_widget(root);
+      arrange(root, root.x, root.y, root.pw, root.ph);
+    }
+
+    if(!(root.flags & (DIRTY | DESCENDANT))) return 0;
+
+    // widgets are opaque so draw with COPY, and leave the caller's drawing
+    // state as it was
+    pen_t previous_pen = _pen;
+    blend_func_t previous_bf = _bf;
+    bool previous_dither = _dither;
+    _bf = COPY;
+
+    uint32_t drawn = draw_tree(root, false);
+
+    _pen = previous_pen;
+    _bf = previous_bf;
+    _dither = previous_dither;
+    return drawn;
+  }
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "picosystem.hpp"
+
+namespace picosystem {
+
+  // retained mode ui
+  //
+  // widgets are linked into a tree under a root panel. panels stack their
+  // children top to bottom, children are stretched to the panel's inner
+  // width. each widget caches its preferred size and its laid out bounds,
+  // changing a widget through the ui_ setters marks it dirty (and only if
+  // the value really changed), and ui_draw() redraws just the dirty widgets
+  // with the clip set to their bounds.
+  //
+  // this relies on the target keeping what was drawn last frame, so draw
+  // the ui somewhere nothing else draws over (e.g. a layer_t surface, or
+  // the screen with in place post processing off). widgets paint their own
+  // background so it should be opaque. call ui_invalidate() on the root if
+  // something else has drawn over the ui or the font has changed.
+  #ifndef PICOSYSTEM_UI_TEXT
+  #define PICOSYSTEM_UI_TEXT 32
+  #endif
+
+  enum widget_kind_t : uint8_t {
+    PANEL,
+    LABEL,
+    LIST,
+    PROGRESS
+  };
+
+  struct widget_t {
+    widget_kind_t kind;
+    uint8_t flags;
+    uint8_t padding;
+    uint8_t spacing;                  // between a panel's children
+
+    int32_t x, y, w, h;               // laid out bounds
+    int32_t pw, ph;                   // cached preferred size
+    int32_t fixed_w, fixed_h;         // size set by the caller, 0 to fit
+
+    widget_t *parent, *first, *next;  // tree links
+
+    pen_t fg, bg, accent;
+
+    char text[PICOSYSTEM_UI_TEXT];    // label
+    uint8_t text_length;
+
+    const std::string_view *items;    // list
+    uint16_t item_count;
+    int16_t selected;
+
+    int32_t value, max;               // progress
+  };
+
+  // root panels are placed at x, y. w and h of 0 fit the contents.
+  widget_t create_panel(int32_t x = 0, int32_t y = 0, int32_t w = 0, int32_t h = 0);
+  widget_t create_label(std::string_view text);
+  widget_t create_list(const std::string_view *items, uint16_t count, int16_t selected = 0);
+  widget_t create_progress(int32_t value, int32_t max, int32_t h = 6);
+
+  // links child as the last child of parent, neither may move in memory
+  // while they are part of a tree
+  void ui_add(widget_t &parent, widget_t &child);
+
+  // redraw the widget and everything inside it on the next ui_draw()
+  void ui_invalidate(widget_t &w);
+
+  // after changing pens or fixed sizes by hand
+  void ui_relayout(widget_t &w);
+
+  void ui_text(widget_t &w, std::string_view text);
+  void ui_value(widget_t &w, int32_t value);
+  void ui_select(widget_t &w, int16_t index);
+
+  // lays out anything whose size changed and redraws the dirty widgets,
+  // returns the number of widgets drawn
+  uint32_t ui_draw(widget_t &root);
+
+}
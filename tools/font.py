@@ -0,0 +1,158 @@
+#!/usr/bin/env python3
+"""Rasterise a font file into picosystem font_t source code.
+
+Each requested size becomes its own font_t with per-glyph widths, kerning
+pairs, and glyph bitmaps stored as rows of (skip, length) runs so that they
+can live in flash and be drawn a span at a time.
+
+  python3 tools/font.py Lato-Regular.ttf -s 10 -s 14 --name lato > lato.cpp
+
+Requires Pillow.
+"""
+
+import argparse
+import sys
+
+from PIL import Image, ImageDraw, ImageFont
+
+
+def parse_ranges(spec):
+    """Parse a character set like "32-126,0xa3,0x20ac" into codepoints."""
+    codepoints = set()
+    for part in spec.split(","):
+        part = part.strip()
+        if not part:
+            continue
+        if "-" in part:
+            lo, hi = part.split("-", 1)
+            codepoints.update(range(int(lo, 0), int(hi, 0) + 1))
+        else:
+            codepoints.add(int(part, 0))
+    return codepoints
+
+
+def rasterise(font, ch, threshold):
+    left, top, right, bottom = font.getbbox(ch)
+    w, h = max(right - left, 0), max(bottom - top, 0)
+    rows = []
+    if w and h:
+        image = Image.new("L", (w, h), 0)
+        ImageDraw.Draw(image).text((-left, -top), ch, font=font, fill=255)
+        pixels = image.load()
+        for y in range(h):
+            rows.append([pixels[x, y] >= threshold for x in range(w)])
+
+    # trim empty rows from the top and bottom of the bitmap
+    while rows and not any(rows[0]):
+        rows.pop(0)
+        top += 1
+    while rows and not any(rows[-1]):
+        rows.pop()
+
+    return left, top, w, rows
+
+
+def encode_runs(rows):
+    """Encode rows of booleans as count, (skip, length)... per row."""
+    data = []
+    for row in rows:
+        runs = []
+        x, last = 0, 0
+        while x < len(row):
+            if row[x]:
+                start = x
+                while x < len(row) and row[x]:
+                    x += 1
+                runs.append((start - last, x - start))
+                last = x
+            else:
+                x += 1
+        data.append(len(runs))
+        for skip, length in runs:
+            data += [skip, length]
+    return data
+
+
+def build(path, size, codepoints, threshold):
+    font = ImageFont.truetype(path, size)
+    ascent, descent = font.getmetrics()
+
+    glyphs, runs = [], []
+    for cp in sorted(codepoints):
+        ch = chr(cp)
+        # skip codepoints the font has no outline or advance for
+        advance = round(font.getlength(ch))
+        if not advance and not font.getmask(ch).getbbox():
+            continue
+
+        x, y, w, rows = rasterise(font, ch, threshold)
+        glyphs.append((cp, len(runs), x, y, w, len(rows), advance))
+        runs += encode_runs(rows)
+
+    # kerning is whatever the layout engine applies to the pair beyond the
+    # sum of the individual advances
+    chars = [chr(g[0]) for g in glyphs if g[0] > 32]
+    kerning = []
+    for a in chars:
+        la = font.getlength(a)
+        for b in chars:
+            adjust = round(font.getlength(a + b) - la - font.getlength(b))
+            if adjust:
+                kerning.append((ord(a), ord(b), max(-128, min(127, adjust))))
+
+    return ascent + descent, glyphs, kerning, runs
+
+
+def emit(out, name, height, glyphs, kerning, runs):
+    out.write(f"  const uint8_t {name}_runs[] = {{\n")
+    for i in range(0, len(runs), 16):
+        out.write("    " + ", ".join(f"0x{v:02x}" for v in runs[i:i + 16]) + ",\n")
+    out.write("  };\n\n")
+
+    out.write(f"  const glyph_t {name}_glyphs[] = {{\n")
+    for cp, offset, x, y, w, h, advance in glyphs:
+        out.write(f"    {{0x{cp:04x}, {offset}, {x}, {y}, {w}, {h}, {advance}}},\n")
+    out.write("  };\n\n")
+
+    if kerning:
+        out.write(f"  const kerning_t {name}_kerning[] = {{\n")
+        for left, right, adjust in kerning:
+            out.write(f"    {{0x{left:04x}, 0x{right:04x}, {adjust}}},\n")
+        out.write("  };\n\n")
+
+    out.write(f"  extern const font_t {name} = {{\n")
+    out.write(f"    {height}, {len(glyphs)}, {name}_glyphs,\n")
+    out.write(f"    {len(kerning)}, {name + '_kerning' if kerning else 'nullptr'},\n")
+    out.write(f"    {name}_runs\n")
+    out.write("  };\n\n")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("font", help="path to a .ttf or .otf font file")
+    parser.add_argument("-s", "--size", type=int, action="append", required=True,
+                        help="pixel size, may be given more than once")
+    parser.add_argument("--name", required=True, help="base name of the generated fonts")
+    parser.add_argument("--chars", default="32-126",
+                        help="codepoints to include, e.g. 32-126,0xa3,0x20ac")
+    parser.add_argument("--threshold", type=int, default=128,
+                        help="coverage (0-255) at which a pixel is set")
+    parser.add_argument("-o", "--output", help="output file (default stdout)")
+    args = parser.parse_args()
+
+    codepoints = parse_ranges(args.chars)
+
+    out = open(args.output, "w") if args.output else sys.stdout
+    out.write("// generated by tools/font.py, do not edit\n\n")
+    out.write('#include "picosystem.hpp"\n\nnamespace picosystem {\n\n')
+    for size in args.size:
+        name = f"{args.name}_{size}"
+        height, glyphs, kerning, runs = build(args.font, size, codepoints, args.threshold)
+        if any(g[4] > 255 or g[5] > 255 for g in glyphs):
+            sys.exit(f"{name}: glyphs must be smaller than 256 pixels")
+        emit(out, name, height, glyphs, kerning, runs)
+    out.write("}\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,117 @@
+// clock governor tests, governor_update() against simulated workloads
+//
+//   ./governor
+
+#include <cstdio>
+
+#include "picosystem.hpp"
+#include "governor.hpp"
+#include "hal.hpp"
+
+using namespace picosystem;
+
+void init() {}
+void update(uint32_t) {}
+void render() {}
+
+namespace {
+
+  constexpr uint32_t FRAME_US = 16667;
+
+  uint32_t failures = 0;
+
+  void check(bool ok, const char *what) {
+    if(!ok) {
+      printf("failed, %s\n", what);
+      failures++;
+    }
+  }
+
+  // microseconds a workload of cycles takes at a clock level
+  uint32_t busy(uint64_t cycles, uint8_t level) {
+    return cycles * 1000 / CLOCK_LEVELS[level];
+  }
+
+  // runs frames of a fixed workload, returns the number of level changes
+  uint32_t run(governor_t &g, uint64_t cycles, uint32_t frames) {
+    uint32_t changes = 0;
+    for(uint32_t i = 0; i < frames; i++) {
+      uint8_t level = g.level;
+      if(governor_update(g, busy(cycles, level), FRAME_US) != level) changes++;
+    }
+    return changes;
+  }
+
+  // cycles that keep the cpu busy for a fraction (of 256) of a frame at a
+  // clock level
+  uint64_t workload(uint32_t load, uint8_t level) {
+    return uint64_t(FRAME_US) * CLOCK_LEVELS[level] / 1000 * load / 256;
+  }
+
+}
+
+int main() {
+  {
+    // a light load steps down a level at a time, holding between steps
+    governor_t g;
+    run(g, workload(26, 0), GOVERNOR_HOLD - 1);
+    check(g.level == 0, "stepped down before the hold ran out");
+    run(g, workload(26, 0), 1);
+    check(g.level == 1, "didn't step down after the hold");
+    run(g, workload(26, 0), GOVERNOR_HOLD * CLOCK_LEVEL_COUNT);
+    check(g.level == CLOCK_LEVEL_COUNT - 1, "light load didn't reach the slowest clock");
+  }
+
+  {
+    // an overrun steps straight back up, whatever the hold
+    governor_t g;
+    run(g, workload(26, 0), GOVERNOR_HOLD * CLOCK_LEVEL_COUNT);
+    uint8_t level = g.level;
+    governor_update(g, FRAME_US + 1, FRAME_US);
+    check(g.level == level - 1, "overrun didn't step up");
+    governor_update(g, FRAME_US + 1, FRAME_US);
+    check(g.level == level - 2, "second overrun didn't step up");
+  }
+
+  {
+    // a heavy load never leaves the fastest clock
+    governor_t g;
+    uint32_t changes = run(g, workload(240, 0), 1000);
+    check(g.level == 0 && !changes, "heavy load left the fastest clock");
+  }
+
+  {
+    // a load just too heavy for the next level down doesn't flip between
+    // the two
+    for(uint8_t level = 0; level < CLOCK_LEVEL_COUNT - 1; level++) {
+      governor_t g;
+      uint64_t cycles = workload(GOVERNOR_DOWN + 4, level + 1);
+      run(g, cycles, 500);
+      uint32_t changes = run(g, cycles, 1000);
+      check(changes == 0, "steady load kept changing level");
+    }
+  }
+
+  {
+    // a frame with no length changes nothing
+    governor_t g;
+    g.level = 2;
+    check(governor_update(g, 1000, 0) == 2 && g.load == 0, "zero length frame was counted");
+  }
+
+  {
+    // turning the governor on again goes back to the fastest clock
+    governor(true);
+    for(uint32_t i = 0; i < GOVERNOR_HOLD * 2; i++) {
+      governor_frame(busy(workload(26, 0), 0), FRAME_US);
+    }
+    check(host::clock_khz != CLOCK_LEVELS[0], "governor didn't slow the clock");
+    governor(true);
+    check(host::clock_khz == CLOCK_LEVELS[0], "re-enabling didn't restore the clock");
+    governor(false);
+  }
+
+  if(failures) return 1;
+  printf("governor: ok\n");
+  return 0;
+}
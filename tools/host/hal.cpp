@@ -0,0 +1,185 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "picosystem.hpp"
+#include "packed.hpp"
+#include "hal.hpp"
+
+namespace host {
+
+  int32_t fail_after = -1;
+  uint32_t erases[PICOSYSTEM_SAVE_SECTORS];
+  uint64_t programmed = 0;
+  uint32_t clock_khz = 250000;
+  int64_t fake_us = -1;
+  uint32_t buttons = 0;
+  uint32_t frames_sent = 0, frames_skipped = 0;
+
+  namespace {
+    uint8_t *flash = nullptr;
+
+    const picosystem::packed_buffer_t *packed_screen = nullptr;
+    bool skip_unchanged_frames = false;
+    bool last_crc_valid = false;
+    uint32_t last_crc;
+
+    // true if this write should be the one that's torn
+    bool fails() {
+      if(fail_after < 0) return false;
+      return fail_after-- == 0;
+    }
+  }
+
+  void flash_open(const char *path) {
+    if(flash) {
+      munmap(flash, picosystem::SAVE_REGION_SIZE);
+      flash = nullptr;
+    }
+
+    if(!path) path = getenv("PICOSYSTEM_FLASH");
+    if(!path) path = "picosystem.flash";
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if(fd < 0) {
+      perror(path);
+      exit(1);
+    }
+
+    off_t size = lseek(fd, 0, SEEK_END);
+    if(size < picosystem::SAVE_REGION_SIZE) {
+      static uint8_t blank[picosystem::SAVE_SECTOR_SIZE];
+      memset(blank, 0xff, sizeof(blank));
+      for(; size < picosystem::SAVE_REGION_SIZE; size += sizeof(blank)) {
+        if(pwrite(fd, blank, sizeof(blank), size) != sizeof(blank)) {
+          perror(path);
+          exit(1);
+        }
+      }
+    }
+
+    // shared so that it's written through even if the process dies
+    void *p = mmap(nullptr, picosystem::SAVE_REGION_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+      perror(path);
+      exit(1);
+    }
+    flash = (uint8_t *)p;
+  }
+
+}
+
+namespace picosystem {
+
+  const uint8_t *flash_data(uint32_t offset) {
+    if(!host::flash) host::flash_open();
+    return host::flash + offset;
+  }
+
+  // a torn erase leaves a random mix of erased and untouched pages
+  void flash_erase_sector(uint32_t offset) {
+    if(!host::flash) host::flash_open();
+    host::erases[offset / SAVE_SECTOR_SIZE]++;
+
+    uint8_t *p = host::flash + offset;
+    if(host::fails()) {
+      for(uint32_t o = 0; o < SAVE_SECTOR_SIZE; o += SAVE_PAGE_SIZE) {
+        if(rand() & 1) memset(p + o, 0xff, SAVE_PAGE_SIZE);
+      }
+      throw host::power_loss();
+    }
+
+    memset(p, 0xff, SAVE_SECTOR_SIZE);
+  }
+
+  // programming only clears bits, a torn program stops part way through
+  void flash_program_page(uint32_t offset, const uint8_t *data) {
+    if(!host::flash) host::flash_open();
+    host::programmed += SAVE_PAGE_SIZE;
+
+    uint8_t *p = host::flash + offset;
+    uint32_t n = host::fails() ? rand() % SAVE_PAGE_SIZE : SAVE_PAGE_SIZE;
+    for(uint32_t i = 0; i < n; i++) {
+      p[i] &= data[i];
+    }
+
+    if(n != SAVE_PAGE_SIZE) throw host::power_loss();
+  }
+
+  uint32_t time_us() {
+    if(host::fake_us >= 0) return host::fake_us;
+
+    static auto start = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  }
+
+  uint32_t time() {
+    return time_us() / 1000;
+  }
+
+  void set_clock(uint32_t khz) {
+    host::clock_khz = khz;
+  }
+
+  // the device's dma sniffer computes crc32() over the frame being sent,
+  // here it's done in software over the same bytes
+  void flip() {
+    if(host::skip_unchanged_frames && post_in_scanout() && !host::packed_screen) {
+      // the crc is of the frame before post processing so can't be used
+      host::last_crc_valid = false;
+    }else if(host::skip_unchanged_frames) {
+      const buffer_t &fb = _screen.buffer;
+      uint32_t crc = host::packed_screen ?
+        crc32(host::packed_screen->data, packed_size(host::packed_screen->w, host::packed_screen->h)) :
+        crc32(fb.data, fb.w * fb.h * sizeof(pen_t));
+
+      if(host::last_crc_valid && crc == host::last_crc) {
+        host::frames_skipped++;
+        return;
+      }
+      host::last_crc = crc;
+      host::last_crc_valid = true;
+    }
+
+    host::frames_sent++;
+  }
+
+  void skip_unchanged(bool enabled) {
+    host::skip_unchanged_frames = enabled;
+    host::last_crc_valid = false;
+  }
+
+  void screen_packed(const packed_buffer_t *b) {
+    host::packed_screen = b;
+    host::last_crc_valid = false;
+  }
+
+  bool packed_scanout() {
+    return host::packed_screen;
+  }
+
+  // everything else does nothing, there's no screen or dma to wait for
+  void init_hardware() {}
+  void backlight(uint8_t) {}
+  void led(uint8_t, uint8_t, uint8_t) {}
+  void idle() {}
+  bool is_flipping() {return false;}
+  bool is_transferring() {return false;}
+  void wait_vsync() {}
+  uint32_t read_buttons() {return host::buttons;}
+  float charge() {return 1.0f;}
+  void reset_to_dfu() {}
+
+  bool dma_fill(pen_t *, uint32_t, uint32_t, uint32_t, pen_t) {return false;}
+  bool dma_copy(const pen_t *, uint32_t, pen_t *, uint32_t, uint32_t, uint32_t) {return false;}
+  bool dma_busy() {return false;}
+  void dma_wait() {}
+
+}
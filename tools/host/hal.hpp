@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+
+#include "save.hpp"
+
+// host stand-in for libraries/hal.cpp
+//
+// enough of the hal for the libraries to run as an ordinary program. the
+// save region is a file so it survives between runs, and erases and page
+// programs can be cut short part way to test recovery from power loss.
+namespace host {
+
+  // thrown by the flash write that power is lost during
+  struct power_loss {};
+
+  // maps the flash image, by default $PICOSYSTEM_FLASH or picosystem.flash.
+  // a missing file is created blank (all 0xff). called by the first flash
+  // access if not before.
+  void flash_open(const char *path = nullptr);
+
+  // the write after this many more is torn and throws power_loss, -1 never
+  extern int32_t fail_after;
+
+  // flash wear so far
+  extern uint32_t erases[PICOSYSTEM_SAVE_SECTORS];
+  extern uint64_t programmed;  // bytes
+
+  // last set_clock()
+  extern uint32_t clock_khz;
+
+  // time() and time_us() follow this when set, the real clock when not
+  extern int64_t fake_us;
+
+  // what read_buttons() returns, bit n is gpio n as on the device
+  extern uint32_t buttons;
+
+  // flips that sent a frame and flips skipped by skip_unchanged()
+  extern uint32_t frames_sent, frames_skipped;
+
+}
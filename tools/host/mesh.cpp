@@ -0,0 +1,112 @@
+// draw_mesh() benchmark, triangles per second for each shading mode with
+// and without a depth buffer or sorting
+//
+//   ./mesh [frames]
+//
+// a sphere spins in front of the camera filling about a third of the
+// screen. the numbers are for the host, they're for comparing changes
+// rather than predicting speed on the device.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "picosystem.hpp"
+#include "mesh.hpp"
+
+using namespace picosystem;
+
+void init() {}
+void update(uint32_t) {}
+void render() {}
+
+namespace {
+
+  constexpr uint32_t RINGS = 16, SEGMENTS = 24;
+  constexpr uint32_t VERTICES = (RINGS + 1) * SEGMENTS;
+  constexpr uint32_t TRIANGLES = RINGS * SEGMENTS * 2;
+
+  vec3_t vertices[VERTICES];
+  uint16_t indices[TRIANGLES * 3];
+  pen_t pens[TRIANGLES];  // per triangle for FLAT, the first VERTICES for GOURAUD
+  fixed_t uvs[VERTICES * 2];
+
+  pen_t texels[32 * 32];
+  buffer_t texture{32, 32, texels};
+
+  uint16_t depth[240 * 240];
+
+  mesh_t sphere() {
+    for(uint32_t r = 0; r <= RINGS; r++) {
+      uint16_t lat = r * 32768 / RINGS;
+      for(uint32_t s = 0; s < SEGMENTS; s++) {
+        uint16_t lon = s * 65536 / SEGMENTS;
+        uint32_t i = r * SEGMENTS + s;
+        fixed_t ring = fixed_sin(lat);
+        vertices[i] = {fixed_mul(ring, fixed_cos(lon)), fixed_cos(lat), fixed_mul(ring, fixed_sin(lon))};
+        uvs[i * 2] = s * 32 * FIXED_ONE / SEGMENTS;
+        uvs[i * 2 + 1] = r * 32 * FIXED_ONE / RINGS;
+      }
+    }
+
+    uint16_t *index = indices;
+    for(uint32_t r = 0; r < RINGS; r++) {
+      for(uint32_t s = 0; s < SEGMENTS; s++) {
+        uint16_t a = r * SEGMENTS + s, b = r * SEGMENTS + (s + 1) % SEGMENTS;
+        uint16_t c = a + SEGMENTS, d = b + SEGMENTS;
+        *index++ = a; *index++ = b; *index++ = c;
+        *index++ = b; *index++ = d; *index++ = c;
+      }
+    }
+
+    for(uint32_t i = 0; i < TRIANGLES; i++) {
+      pens[i] = pen_t(0xf0 | (i & 0xf) | ((i >> 4) & 0xf) << 12 | (15 - (i & 0xf)) << 8);
+    }
+
+    for(uint32_t i = 0; i < 32 * 32; i++) {
+      texels[i] = ((i ^ (i >> 5)) & 4) ? 0xfff0 : 0x00f8;
+    }
+
+    return {vertices, VERTICES, indices, TRIANGLES, pens, uvs, &texture};
+  }
+
+  void bench(const mesh_t &mesh, const char *name, shading_t shading, bool depth_test, bool sort,
+             uint32_t frames) {
+    camera_t camera{translation(0, 0, 4 * FIXED_ONE), 200 * FIXED_ONE, FIXED_ONE / 8};
+    depth_buffer(depth_test ? depth : nullptr);
+    blend_mode(COPY);
+
+    uint64_t drawn = 0;
+    auto start = std::chrono::steady_clock::now();
+    for(uint32_t f = 0; f < frames; f++) {
+      reset(_frame_arena);
+      pen(0);
+      clear();
+      if(depth_test) clear_depth();
+
+      mat_t model = rotation_y(f * 300) * rotation_x(f * 170);
+      drawn += draw_mesh(mesh, model, camera, shading, sort);
+    }
+    double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%-8s %-6s %5.0f triangles per frame, %6.0f frames/s, %9.0f triangles/s\n",
+           name, depth_test ? "depth" : sort ? "sorted" : "", double(drawn) / frames,
+           frames / s, drawn / s);
+  }
+
+}
+
+int main(int argc, char **argv) {
+  uint32_t frames = argc > 1 ? atoi(argv[1]) : 500;
+  mesh_t mesh = sphere();
+  printf("sphere of %u vertices, %u triangles, %u frames each\n", VERTICES, TRIANGLES, frames);
+
+  const char *names[] = {"flat", "gouraud", "textured"};
+  for(shading_t shading : {FLAT, GOURAUD, TEXTURED}) {
+    bench(mesh, names[shading], shading, false, false, frames);
+    bench(mesh, names[shading], shading, false, true, frames);
+    bench(mesh, names[shading], shading, true, false, frames);
+  }
+
+  return 0;
+}
@@ -0,0 +1,145 @@
+// record and replay through the real main loop
+//
+// a small game is played for a while with random input and a jittery
+// clock while its frames are recorded, then the recording is replayed
+// twice, started from render() as a game would, and every replayed frame's
+// hash must match the frame drawn when it was recorded.
+//
+//   ./replay [frames]
+//
+// the time each pass spends in the main loop is printed too, so a replay
+// doubles as a repeatable benchmark of the drawing code.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+#include "picosystem.hpp"
+#include "replay.hpp"
+#include "hal.hpp"
+
+using namespace picosystem;
+
+int picosystem_main();
+
+namespace {
+
+  constexpr uint32_t MAX_FRAMES = 4096;
+
+  struct done {};
+
+  enum pass_t {RECORD, REPLAY};
+  pass_t pass;
+  uint32_t frames, frame;
+
+  replay_frame_t recorded[MAX_FRAMES];
+  replay_t recording{recorded, MAX_FRAMES, 0, 0, 0};
+  uint32_t expected[MAX_FRAMES];
+  uint32_t hashes, mismatches;
+
+  // the game
+  struct {
+    int32_t x, y;
+    uint32_t tick;
+    uint32_t trail[16];
+  } world;
+
+  void start_world() {
+    world = {};
+    world.x = world.y = 112;
+  }
+
+  void check_hash(uint32_t frame, uint32_t hash) {
+    if(frame >= recording.count || hash != expected[frame]) {
+      if(!mismatches++) printf("frame %u hash %08x, expected %08x\n", frame, hash, expected[frame]);
+    }
+    hashes++;
+  }
+
+  void next_frame() {
+    // the main loop's clock moves on by 14-20ms a frame and a random
+    // button or two is held for a while
+    host::fake_us += 14000 + rand() % 6000;
+    if(rand() % 8 == 0) {
+      host::buttons = (1U << UP) * (rand() & 1) | (1U << LEFT) * (rand() & 1) |
+                      (1U << DOWN) * (rand() & 1) | (1U << RIGHT) * (rand() & 1) |
+                      (1U << A) * (rand() & 1);
+    }
+  }
+
+  double run(pass_t p, uint32_t count) {
+    pass = p;
+    frames = count;
+    frame = 0;
+    host::fake_us = 0;
+    host::buttons = 0;
+    srand(p == RECORD ? 1 : 2);  // different live input each pass
+
+    auto start = std::chrono::steady_clock::now();
+    try {
+      picosystem_main();
+    } catch(const done &) {}
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  }
+
+}
+
+void init() {
+  start_world();
+  if(pass == RECORD) record(recording);
+}
+
+void update(uint32_t tick) {
+  world.tick = tick;
+  if(pressed(LEFT))  world.x -= 2;
+  if(pressed(RIGHT)) world.x += 2;
+  if(pressed(UP))    world.y -= 2;
+  if(pressed(DOWN))  world.y += 2;
+  world.x = std::clamp<int32_t>(world.x, 0, 224);
+  world.y = std::clamp<int32_t>(world.y, 0, 224);
+  world.trail[tick / 10 % 16] = world.x | world.y << 16;
+}
+
+void render() {
+  if(pass == REPLAY && frame == 0) {
+    replay(recording, check_hash);
+    start_world();
+  }
+
+  pen(0, 0, 4);
+  clear();
+  for(uint32_t i = 0; i < 16; i++) {
+    pen(i, 15 - i, 8, 8);
+    rectangle(world.trail[i] & 0xffff, world.trail[i] >> 16, 16, 16);
+  }
+  pen(15, 15, pressed(A) ? 0 : 15);
+  rectangle(world.x, world.y, 16, 16);
+  text(std::to_string(world.tick), 2, 2);
+
+  if(pass == RECORD && frame < MAX_FRAMES) expected[frame] = hash(_screen.buffer);
+
+  next_frame();
+  if(++frame == frames) throw done();
+}
+
+int main(int argc, char **argv) {
+  uint32_t count = std::min<uint32_t>(argc > 1 ? atoi(argv[1]) : 1000, MAX_FRAMES - 1);
+
+  double ms = run(RECORD, count);
+  stop_replay();
+  printf("recorded %u frames in %.1fms\n", recording.count, ms);
+
+  for(uint32_t i = 0; i < 2; i++) {
+    hashes = mismatches = 0;
+    // the replay starts a frame late and the hash of its last frame is
+    // taken after render(), so it needs two more frames than were recorded
+    ms = run(REPLAY, recording.count + 2);
+    printf("replayed %u frames in %.1fms, %u hashes differ\n", hashes, ms, mismatches);
+    if(mismatches || hashes != recording.count) {
+      printf("failed\n");
+      return 1;
+    }
+  }
+
+  return 0;
+}
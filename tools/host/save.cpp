@@ -0,0 +1,305 @@
+// save store tests against the file backed flash of the host hal
+//
+// every boot runs in a forked process so that the store's state is lost
+// with it, just as on a real power cut. the model of what should be saved
+// lives in shared memory so it survives.
+//
+//   ./save [boots]
+//
+// the fuzz test cuts the power part way through a random erase or page
+// program on each boot and checks that the next boot finds every value
+// either as it was or (for the one write in flight) as it was written.
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "picosystem.hpp"
+#include "save.hpp"
+#include "hal.hpp"
+
+using namespace picosystem;
+
+void init() {}
+void update(uint32_t) {}
+void render() {}
+
+namespace {
+
+  constexpr uint32_t KEYS = 32;
+  constexpr uint32_t FUZZ_KEYS = 16;
+  constexpr uint32_t FUZZ_MAX_LENGTH = 300;
+
+  struct value_t {
+    uint32_t version;
+    int32_t length;  // -1 if there's no value
+  };
+
+  struct model_t {
+    value_t saved[KEYS];
+    int32_t flight_key;  // key being written when the power went, or -1
+    value_t flight;
+    char error[256];
+  };
+
+  model_t *model;
+  const char *flash_path = "save.flash";
+
+  uint8_t content(uint32_t key, uint32_t version, uint32_t i) {
+    uint32_t v = (key * 2654435761u) ^ (version * 40503u) ^ (i * 97u);
+    return v ^ (v >> 11);
+  }
+
+  void fill(uint8_t *data, uint32_t key, const value_t &v) {
+    for(int32_t i = 0; i < v.length; i++) data[i] = content(key, v.version, i);
+  }
+
+  bool matches(const uint8_t *data, int32_t length, uint32_t key, const value_t &v) {
+    if(length != v.length) return false;
+    for(int32_t i = 0; i < length; i++) {
+      if(data[i] != content(key, v.version, i)) return false;
+    }
+    return true;
+  }
+
+  void fail(const char *format, ...) __attribute__((format(printf, 1, 2)));
+  void fail(const char *format, ...) {
+    va_list args;
+    va_start(args, format);
+    vsnprintf(model->error, sizeof(model->error), format, args);
+    va_end(args);
+    fflush(stdout);
+    _exit(1);
+  }
+
+  // runs f in a fresh process, returns false if it failed
+  template<typename F>
+  bool boot(F f) {
+    fflush(stdout);
+    pid_t pid = fork();
+    if(pid == 0) {
+      host::flash_open(flash_path);
+      try {
+        f();
+      } catch(const host::power_loss &) {}
+      fflush(stdout);
+      _exit(0);
+    }
+
+    int status;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+
+  void fresh(const char *path) {
+    flash_path = path;
+    unlink(path);
+    memset(model, 0, sizeof(model_t));
+    for(auto &v : model->saved) v.length = -1;
+    model->flight_key = -1;
+  }
+
+  bool write(uint32_t key, const value_t &v) {
+    static uint8_t data[SAVE_MAX_LENGTH];
+    if(v.length < 0) return save_remove(key);
+
+    fill(data, key, v);
+    return save_write(key, data, v.length);
+  }
+
+  // checks every key against the model, settling the write in flight
+  void verify() {
+    static uint8_t data[SAVE_MAX_LENGTH];
+
+    for(uint32_t key = 0; key < KEYS; key++) {
+      int32_t length = save_read(key, data, sizeof(data));
+      const value_t &saved = model->saved[key];
+
+      if(model->flight_key == int32_t(key) && matches(data, length, key, model->flight)) {
+        model->saved[key] = model->flight;
+      }else if(!matches(data, length, key, saved)) {
+        fail("key %u has length %d, expected %d (version %u)",
+             key, length, saved.length, saved.version);
+      }
+    }
+
+    model->flight_key = -1;
+  }
+
+  // a boot that loses power after a random number of flash writes
+  void fuzz_boot(uint32_t seed) {
+    srand(seed);
+    host::fail_after = rand() % 64;
+
+    verify();
+
+    for(uint32_t op = 0; op < 1000; op++) {
+      uint32_t key = rand() % FUZZ_KEYS;
+      value_t v{model->saved[key].version + 1, int32_t(rand() % (FUZZ_MAX_LENGTH + 1))};
+      if(rand() % 8 == 0) v.length = -1;
+
+      model->flight_key = key;
+      model->flight = v;
+      if(!write(key, v)) fail("write of key %u refused", key);
+      if(!save_flush()) fail("flush of key %u failed", key);
+      model->saved[key] = v;
+      model->flight_key = -1;
+    }
+  }
+
+  bool fuzz(uint32_t boots) {
+    fresh("save.flash");
+    for(uint32_t i = 0; i < boots; i++) {
+      if(!boot([i]{fuzz_boot(i);})) {
+        printf("fuzz: boot %u: %s\n", i, model->error);
+        return false;
+      }
+    }
+
+    if(!boot(verify)) {
+      printf("fuzz: final boot: %s\n", model->error);
+      return false;
+    }
+
+    printf("fuzz: %u power cuts recovered\n", boots);
+    return true;
+  }
+
+  // values the size of a quarter sector fill the head exactly when it's
+  // compacted, the flush has to keep rotating until there's room
+  bool full_head() {
+    fresh("full.flash");
+    bool ok = boot([]{
+      for(uint32_t i = 0; i < 60; i++) {
+        uint32_t key = i < 4 ? i : 4;
+        value_t v{i + 1, int32_t(SAVE_MAX_LENGTH)};
+        if(!write(key, v) || !save_flush()) fail("flush %u failed", i);
+        model->saved[key] = v;
+      }
+    }) && boot(verify);
+
+    printf("full head: %s\n", ok ? "ok" : model->error);
+    return ok;
+  }
+
+  uint32_t erases() {
+    uint32_t n = 0;
+    for(uint32_t e : host::erases) n += e;
+    return n;
+  }
+
+  // save_service() erases at most one sector per call, what needs another
+  // rotation waits for the next
+  bool service() {
+    fresh("service.flash");
+    bool ok = boot([]{
+      host::fake_us = 0;
+      uint32_t calls = 0;
+      for(uint32_t i = 0; i < 60; i++) {
+        uint32_t key = i < 4 ? i : 4;
+        value_t v{i + 1, int32_t(SAVE_MAX_LENGTH)};
+        if(!write(key, v)) fail("write %u refused", i);
+        model->saved[key] = v;
+
+        host::fake_us += PICOSYSTEM_SAVE_FLUSH_MS * 1000;
+        while(save_pending()) {
+          uint32_t before = erases();
+          if(!save_service()) fail("service did nothing with %u bytes pending", save_pending());
+          if(erases() - before > 1) fail("service erased %u sectors in one call", erases() - before);
+          if(++calls > 60 * PICOSYSTEM_SAVE_SECTORS) fail("service never finished");
+        }
+      }
+      printf("service: 60 flushes in %u calls\n", calls);
+    }) && boot(verify);
+
+    printf("service: %s\n", ok ? "ok" : model->error);
+    return ok;
+  }
+
+  // writing more than fits fails without losing what's already saved, and
+  // there's room again once values are removed
+  bool over_capacity() {
+    fresh("over.flash");
+    bool ok = boot([]{
+      for(uint32_t key = 0; key < KEYS; key++) {
+        value_t v{1, int32_t(SAVE_MAX_LENGTH)};
+        if(!write(key, v)) fail("write of key %u refused", key);
+        if(!save_flush()) {
+          if(!save_pending()) fail("key %u dropped from the buffer", key);
+
+          static uint8_t data[SAVE_MAX_LENGTH];
+          int32_t length = save_read(key, data, sizeof(data));
+          if(!matches(data, length, key, v)) fail("key %u unreadable while pending", key);
+
+          printf("over capacity: full after %u values\n", key);
+          return;
+        }
+        model->saved[key] = v;
+      }
+      fail("never ran out of room");
+    }) && boot(verify) && boot([]{
+      value_t removed{2, -1}, v{1, int32_t(SAVE_MAX_LENGTH)};
+      if(!write(0, removed) || !save_flush()) fail("remove failed");
+      model->saved[0] = removed;
+
+      uint32_t key = 0;
+      while(model->saved[key].length >= 0) key++;
+      if(!write(key, v) || !save_flush()) fail("no room after a remove");
+      model->saved[key] = v;
+    }) && boot(verify);
+
+    printf("over capacity: %s\n", ok ? "ok" : model->error);
+    return ok;
+  }
+
+  // flash wear for a typical settings store, flushing after every write and
+  // after every eight
+  bool wear(uint32_t batch) {
+    fresh("wear.flash");
+    return boot([batch]{
+      constexpr uint32_t WRITES = 20000, LENGTH = 64;
+      for(uint32_t i = 0; i < WRITES; i++) {
+        uint32_t key = i % FUZZ_KEYS;
+        value_t v{model->saved[key].version + 1, LENGTH};
+        if(!write(key, v)) fail("write %u refused", i);
+        if(i % batch == batch - 1 && !save_flush()) fail("flush %u failed", i);
+        model->saved[key] = v;
+      }
+      verify();
+
+      uint32_t lo = UINT32_MAX, hi = 0;
+      for(uint32_t e : host::erases) {
+        lo = std::min(lo, e);
+        hi = std::max(hi, e);
+      }
+      printf("wear, flush every %u: %u writes of %u bytes, %u-%u erases per sector, "
+             "write amplification %.2f\n", batch, WRITES, LENGTH, lo, hi,
+             double(host::programmed) / (WRITES * LENGTH));
+    });
+  }
+
+}
+
+int main(int argc, char **argv) {
+  uint32_t boots = argc > 1 ? atoi(argv[1]) : 2000;
+
+  void *p = mmap(nullptr, sizeof(model_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if(p == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  model = (model_t *)p;
+
+  bool ok = full_head() && service() && over_capacity() && fuzz(boots) && wear(1) && wear(8);
+  if(!ok) {
+    printf("failed\n");
+    return 1;
+  }
+
+  return 0;
+}
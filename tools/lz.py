@@ -0,0 +1,168 @@
+#!/usr/bin/env python3
+"""Compress an asset into the picosystem lz container.
+
+The output is read by lz_decompress() and lz_open()/lz_read(), see
+libraries/lz.hpp for the format. Either raw bytes or C++ source with the
+data in a named array can be written.
+
+  python3 tools/lz.py level1.bin -o level1.lz
+  python3 tools/lz.py sprites.bin --name sprites -o sprites.cpp
+
+Pass --verify to decompress the result and check it round trips.
+"""
+
+import argparse
+import struct
+import sys
+
+MIN_MATCH = 4
+MAX_OFFSET = 65535
+
+
+def write_length(out, length):
+    """Append the extension bytes for a length whose nibble was 15."""
+    length -= 15
+    while length >= 255:
+        out.append(255)
+        length -= 255
+    out.append(length)
+
+
+def write_sequence(out, literals, offset=0, match=0):
+    lit_nibble = min(len(literals), 15)
+    match_nibble = min(match - MIN_MATCH, 15) if match else 0
+    out.append((lit_nibble << 4) | match_nibble)
+    if lit_nibble == 15:
+        write_length(out, len(literals))
+    out += literals
+    if match:
+        out += struct.pack("<H", offset)
+        if match_nibble == 15:
+            write_length(out, match - MIN_MATCH)
+
+
+def compress(data, window_bits, chain=64):
+    """Greedy lz77 with hash chains, one step of lazy matching."""
+    window = min(1 << window_bits, MAX_OFFSET)
+    heads, prev = {}, [0] * len(data)
+    out = bytearray()
+
+    def insert(i):
+        if i + MIN_MATCH <= len(data):
+            key = data[i:i + MIN_MATCH]
+            prev[i] = heads.get(key, -1)
+            heads[key] = i
+
+    def longest(i):
+        best_len, best_off = 0, 0
+        if i + MIN_MATCH > len(data):
+            return best_len, best_off
+        candidate = heads.get(data[i:i + MIN_MATCH], -1)
+        for _ in range(chain):
+            if candidate < 0 or i - candidate > window:
+                break
+            length = 0
+            limit = len(data) - i
+            while length < limit and data[candidate + length] == data[i + length]:
+                length += 1
+            if length > best_len:
+                best_len, best_off = length, i - candidate
+            candidate = prev[candidate]
+        return best_len, best_off
+
+    i, anchor, hashed = 0, 0, 0
+
+    def insert_upto(n):
+        nonlocal hashed
+        while hashed < n:
+            insert(hashed)
+            hashed += 1
+
+    while i < len(data):
+        insert_upto(i)
+        length, offset = longest(i)
+        if length >= MIN_MATCH:
+            # prefer a longer match starting at the next byte
+            insert_upto(i + 1)
+            next_length, next_offset = longest(i + 1)
+            if next_length > length + 1:
+                i += 1
+                length, offset = next_length, next_offset
+            write_sequence(out, data[anchor:i], offset, length)
+            i += length
+            anchor = i
+        else:
+            i += 1
+
+    write_sequence(out, data[anchor:])
+    header = b"PSLZ" + struct.pack("<IB3x", len(data), window_bits)
+    return header + bytes(out)
+
+
+def decompress(blob):
+    """Reference decoder, matches lz_decompress()."""
+    assert blob[:4] == b"PSLZ"
+    size, window_bits = struct.unpack_from("<IB", blob, 4)
+    p, out = 12, bytearray()
+
+    def length(nibble):
+        nonlocal p
+        if nibble == 15:
+            while True:
+                b = blob[p]
+                p += 1
+                nibble += b
+                if b != 255:
+                    break
+        return nibble
+
+    while True:
+        token = blob[p]
+        p += 1
+        n = length(token >> 4)
+        out += blob[p:p + n]
+        p += n
+        if len(out) == size:
+            return bytes(out)
+        offset = struct.unpack_from("<H", blob, p)[0]
+        p += 2
+        n = length(token & 15) + MIN_MATCH
+        assert 0 < offset <= min(len(out), 1 << window_bits)
+        for _ in range(n):
+            out.append(out[-offset])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("input", help="file to compress")
+    parser.add_argument("-w", "--window-bits", type=int, default=12,
+                        help="log2 of the match window, the ram a streaming reader needs (default 12)")
+    parser.add_argument("--name", help="write c++ source defining this array instead of raw bytes")
+    parser.add_argument("--verify", action="store_true", help="check the output decompresses")
+    parser.add_argument("-o", "--output", required=True, help="output file")
+    args = parser.parse_args()
+
+    if not 4 <= args.window_bits <= 16:
+        sys.exit("window bits must be between 4 and 16")
+
+    data = open(args.input, "rb").read()
+    blob = compress(data, args.window_bits)
+    if args.verify and decompress(blob) != data:
+        sys.exit(f"{args.input}: round trip failed")
+
+    if args.name:
+        with open(args.output, "w") as out:
+            out.write("// generated by tools/lz.py, do not edit\n\n")
+            out.write("#include <cstdint>\n\nnamespace picosystem {\n\n")
+            out.write(f"  extern const uint8_t {args.name}[{len(blob)}] = {{\n")
+            for i in range(0, len(blob), 16):
+                out.write("    " + ", ".join(f"0x{b:02x}" for b in blob[i:i + 16]) + ",\n")
+            out.write("  };\n\n}\n")
+    else:
+        open(args.output, "wb").write(blob)
+
+    print(f"{args.input}: {len(data)} -> {len(blob)} bytes", file=sys.stderr)
+
+
+if __name__ == "__main__":
+    main()
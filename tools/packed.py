@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Check that a packed framebuffer scans out the same as a pen_t one.
+
+Models the bits each screen pio program sends to the st7789. The pen_t
+path reads the framebuffer as byte swapped 32-bit words and skips the
+alpha nibble of every pixel, the packed path (libraries/packed.hpp)
+streams every bit. Given a raw pen_t frame and a packed frame, both
+dumped straight from memory, the two streams must be identical.
+
+  python3 tools/packed.py frame.bin packed.bin
+  python3 tools/packed.py frame.bin -o packed.bin
+
+Pass --self-test to check the reference packer against the pen_t
+scanout on random frames.
+"""
+
+import argparse
+import random
+import struct
+import sys
+
+
+def words(data):
+    """The 32-bit words the dma feeds the pio, after its byte swap."""
+    if len(data) % 4:
+        raise ValueError("frame is not a whole number of words")
+    return struct.unpack(">%dI" % (len(data) // 4), data)
+
+
+def scanout_pens(data):
+    """12-bit values sent by the screen program for a pen_t frame."""
+    out = []
+    for w in words(data):
+        # per pixel: 4 alpha bits discarded then 12 bits, msb first
+        out.append((w >> 16) & 0xfff)
+        out.append(w & 0xfff)
+    return out
+
+
+def scanout_packed(data):
+    """12-bit values sent by the screen_packed program."""
+    out = []
+    ws = words(data)
+    for i in range(0, len(ws), 3):
+        bits = (ws[i] << 64) | (ws[i + 1] << 32) | ws[i + 2]
+        for j in range(8):
+            out.append((bits >> (84 - j * 12)) & 0xfff)
+    return out
+
+
+def pack(data):
+    """Reference packer, pairs of pen_t (ggggbbbbaaaarrrr) into 3 bytes."""
+    pens = struct.unpack("<%dH" % (len(data) // 2), data)
+    out = bytearray()
+    for p0, p1 in zip(pens[0::2], pens[1::2]):
+        r0, b0, g0 = p0 & 0xf, (p0 >> 8) & 0xf, p0 >> 12
+        r1, b1, g1 = p1 & 0xf, (p1 >> 8) & 0xf, p1 >> 12
+        out += bytes(((r0 << 4) | g0, (b0 << 4) | r1, (g1 << 4) | b1))
+    return bytes(out)
+
+
+def compare(pens, packed):
+    a, b = scanout_pens(pens), scanout_packed(packed)
+    if len(a) != len(b):
+        return "pen_t frame sends %d pixels, packed frame %d" % (len(a), len(b))
+    for i, (x, y) in enumerate(zip(a, b)):
+        if x != y:
+            return "pixel %d differs, %03x != %03x" % (i, x, y)
+    return None
+
+
+def self_test(count):
+    rng = random.Random(1)
+    for i in range(count):
+        pixels = 8 * rng.randint(1, 64)
+        frame = bytes(rng.getrandbits(8) for _ in range(pixels * 2))
+        error = compare(frame, pack(frame))
+        if error:
+            return "frame %d: %s" % (i, error)
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("frame", nargs="?", help="raw pen_t frame")
+    parser.add_argument("packed", nargs="?", help="raw packed frame to check against it")
+    parser.add_argument("-o", "--output", help="write the reference packing of frame")
+    parser.add_argument("--self-test", action="store_true", help="check the reference packer")
+    args = parser.parse_args()
+
+    if args.self_test:
+        error = self_test(200)
+        if error:
+            sys.exit("self test failed, " + error)
+        print("self test passed")
+        if not args.frame:
+            return
+
+    if not args.frame:
+        parser.error("a frame is needed")
+
+    with open(args.frame, "rb") as f:
+        frame = f.read()
+    if len(frame) % 16:
+        sys.exit("%s: frame must be a multiple of 8 pixels" % args.frame)
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(pack(frame))
+
+    if args.packed:
+        with open(args.packed, "rb") as f:
+            packed = f.read()
+        error = compare(frame, packed)
+        if error:
+            sys.exit("%s: %s" % (args.packed, error))
+        print("%s: %d pixels identical" % (args.packed, len(frame) // 2))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,276 @@
+#!/usr/bin/env python3
+"""Simulate the screen pio programs and check the bits they send.
+
+Assembles a program from libraries/screen.pio (just the instructions and
+directives the screen programs use), feeds it a frame the way the scanout
+dma does, and records the data pin on every rising edge of the clock. The
+pixels received are compared with the frame, and the cycle count and the
+shortest clock phases are reported against the st7789's serial timing.
+A fractional divider spaces pio cycles by whole system clocks, so a phase
+of n pio cycles can be as short as floor(n * divider) system clocks and
+that worst case is what's checked.
+
+  python3 tools/piosim.py libraries/screen.pio
+  python3 tools/piosim.py libraries/screen.pio --program screen_packed
+  python3 tools/piosim.py libraries/screen.pio --frame frame.bin --khz 200000
+
+Without --frame a random 240x240 frame is used. screen_packed programs are
+fed the frame packed with tools/packed.py's reference packer.
+"""
+
+import argparse
+import random
+import re
+import struct
+import sys
+
+from packed import pack
+
+# st7789 serial write timing in ns
+MIN_CYCLE = 16
+MIN_HIGH = 7
+MIN_LOW = 7
+
+
+class Stall(Exception):
+    pass
+
+
+def parse(source, name):
+    """The instructions of program `name` with its wrap and side-set."""
+    program, found = None, False
+    labels = {}
+    side_bits, side_opt = 0, False
+    wrap_target, wrap = 0, None
+
+    for line in source.splitlines():
+        line = line.split(";")[0].strip()
+        if not line:
+            continue
+
+        if line.startswith(".program"):
+            found = line.split()[1] == name
+            if found:
+                program = []
+            continue
+        if not found:
+            continue
+
+        if line.startswith(".side_set"):
+            parts = line.split()
+            side_bits, side_opt = int(parts[1]), "opt" in parts[2:]
+        elif line == ".wrap_target":
+            wrap_target = len(program)
+        elif line == ".wrap":
+            wrap = len(program) - 1
+        elif line.startswith("."):
+            raise ValueError("unsupported directive " + line)
+        elif line.endswith(":"):
+            labels[line[:-1]] = len(program)
+        else:
+            m = re.match(r"(.*?)(?:\s+side\s+(\d+))?(?:\s*\[(\d+)\])?$", line)
+            ops = m.group(1).replace(",", " ").split()
+            side = int(m.group(2)) if m.group(2) else None
+            if side is None and side_bits and not side_opt:
+                raise ValueError("side-set required: " + line)
+            program.append((ops, side, int(m.group(3) or 0)))
+
+    if program is None:
+        raise ValueError("no program named " + name)
+    if wrap is None:
+        wrap = len(program) - 1
+
+    # resolve jump targets now labels are known
+    program = [(ops[:-1] + [labels.get(ops[-1], ops[-1])] if ops[0] == "jmp" else ops, side, delay)
+               for ops, side, delay in program]
+    return program, wrap_target, wrap
+
+
+class Machine:
+    def __init__(self, program, wrap_target, wrap, fifo, autopull=True, threshold=32):
+        self.program, self.wrap_target, self.wrap = program, wrap_target, wrap
+        self.fifo, self.fi = fifo, 0
+        self.autopull, self.threshold = autopull, threshold
+        self.osr, self.count = 0, 32  # empty
+        self.x = self.y = 0
+        self.pc = 0
+        self.mosi = self.sck = 0
+        self.cycles = 0
+        self.bits = []
+        self.edges = []  # cycle of each clock transition
+
+    def pull(self):
+        if self.fi == len(self.fifo):
+            raise Stall()
+        self.osr, self.count = self.fifo[self.fi], 0
+        self.fi += 1
+
+    def out(self, n):
+        if self.autopull and self.count >= self.threshold:
+            self.pull()
+        value = self.osr >> (32 - n) if n else 0
+        self.osr = (self.osr << n) & 0xffffffff
+        self.count = min(self.count + n, 32)
+        return value
+
+    def side(self, value):
+        if value is None or value == self.sck:
+            return
+        self.edges.append(self.cycles)
+        self.sck = value
+        if value:
+            self.bits.append(self.mosi)
+
+    def step(self):
+        ops, side, delay = self.program[self.pc]
+        next_pc = self.pc + 1 if self.pc != self.wrap else self.wrap_target
+
+        try:
+            next_pc = self.execute(ops, next_pc)
+        except Stall:
+            # side-set still applies while stalled, finishing the last bit
+            self.side(side)
+            self.cycles += 1
+            raise
+
+        self.side(side)
+        self.cycles += 1 + delay
+        self.pc = next_pc
+
+    def execute(self, ops, next_pc):
+        op = ops[0]
+        if op == "out":
+            dest, n = ops[1], int(ops[2]) % 32 or 32
+            value = self.out(n)
+            if dest == "pins":
+                self.mosi = value & 1
+            elif dest == "x":
+                self.x = value
+            elif dest == "y":
+                self.y = value
+            elif dest != "null":
+                raise ValueError("unsupported out " + dest)
+        elif op == "pull":
+            if "ifempty" in ops and self.count < self.threshold:
+                pass
+            else:
+                self.pull()
+        elif op == "set":
+            dest, value = ops[1], int(ops[2], 0)
+            if dest == "x":
+                self.x = value
+            elif dest == "y":
+                self.y = value
+            elif dest == "pins":
+                self.mosi = value & 1
+            else:
+                raise ValueError("unsupported set " + dest)
+        elif op == "jmp":
+            cond, target = (ops[1] if len(ops) == 3 else None), int(ops[-1])
+            taken = True
+            if cond == "x--":
+                taken, self.x = self.x != 0, (self.x - 1) & 0xffffffff
+            elif cond == "y--":
+                taken, self.y = self.y != 0, (self.y - 1) & 0xffffffff
+            elif cond == "!x":
+                taken = self.x == 0
+            elif cond == "!y":
+                taken = self.y == 0
+            elif cond is not None:
+                raise ValueError("unsupported jmp " + cond)
+            if taken:
+                next_pc = target
+        elif op != "nop":
+            raise ValueError("unsupported instruction " + op)
+        return next_pc
+
+    def run(self):
+        try:
+            while True:
+                self.step()
+        except Stall:
+            pass
+
+
+def pixels(data):
+    """12-bit rgb values of a pen_t (ggggbbbbaaaarrrr) frame."""
+    pens = struct.unpack("<%dH" % (len(data) // 2), data)
+    return [((p & 0xf) << 8) | ((p >> 12) << 4) | ((p >> 8) & 0xf) for p in pens]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("source", help="pio source, e.g. libraries/screen.pio")
+    parser.add_argument("--program", default="screen", help="program to run (default screen)")
+    parser.add_argument("--frame", help="raw pen_t frame (default random)")
+    parser.add_argument("--width", type=int, default=240)
+    parser.add_argument("--height", type=int, default=240)
+    parser.add_argument("--khz", type=int, default=250000, help="system clock (default 250000)")
+    parser.add_argument("--divider", type=float,
+                        help="pio clock divider (default as retune_clocks() picks, "
+                             "the next whole number at or above khz / 125000)")
+    parser.add_argument("--no-autopull", action="store_true")
+    args = parser.parse_args()
+
+    with open(args.source) as f:
+        program, wrap_target, wrap = parse(f.read(), args.program)
+
+    if args.frame:
+        with open(args.frame, "rb") as f:
+            frame = f.read()
+    else:
+        rng = random.Random(1)
+        frame = bytes(rng.getrandbits(8) for _ in range(args.width * args.height * 2))
+    if len(frame) % 16:
+        sys.exit("frame must be a multiple of 8 pixels")
+
+    # the dma reads words with a byte swap, so the pio sees them big endian
+    data = pack(frame) if "packed" in args.program else frame
+    words = list(struct.unpack(">%dI" % (len(data) // 4), data))
+
+    sm = Machine(program, wrap_target, wrap, words, autopull=not args.no_autopull)
+    sm.run()
+
+    expected = pixels(frame)
+    received = [int("".join(map(str, sm.bits[i:i + 12])), 2) for i in range(0, len(sm.bits) - 11, 12)]
+    error = None
+    if len(received) != len(expected) or len(sm.bits) % 12:
+        error = "sent %d bits, expected %d" % (len(sm.bits), len(expected) * 12)
+    else:
+        for i, (a, b) in enumerate(zip(received, expected)):
+            if a != b:
+                error = "pixel %d is %03x, expected %03x" % (i, a, b)
+                break
+
+    divider = args.divider or -(-args.khz // 125000)
+    clock_ns = 1e6 / args.khz
+    ns = clock_ns * divider
+
+    def shortest(cycles):
+        """Shortest time in ns that a span of pio cycles can take."""
+        return min(int(c * divider) for c in cycles) * clock_ns if cycles else 0
+
+    phases = [b - a for a, b in zip(sm.edges, sm.edges[1:])]
+    high = shortest(phases[0::2])  # edges start with a rise
+    low = shortest(phases[1::2])
+    period = shortest([a + b for a, b in zip(phases[1::2], phases[2::2])])
+    ms = sm.cycles * ns / 1e6
+
+    print("%s: %d instructions, %d cycles for %d pixels (%.2f per pixel)" % (
+        args.program, len(program), sm.cycles, len(expected), sm.cycles / len(expected)))
+    print("pio at %.2fmhz (divider %.4f): %.2fms per frame, %.1f fps max" % (
+        1e3 / ns, divider, ms, 1e3 / ms))
+    print("shortest clock high %.1fns, low %.1fns, period %.1fns" % (high, low, period))
+
+    # compared in whole picoseconds so that exact timings don't fail on
+    # rounding
+    if round(high * 1000) < MIN_HIGH * 1000 or round(low * 1000) < MIN_LOW * 1000 or \
+       round(period * 1000) < MIN_CYCLE * 1000:
+        error = error or "clock is faster than the st7789 allows"
+    if error:
+        sys.exit("failed, " + error)
+    print("bitstream matches the frame")
+
+
+if __name__ == "__main__":
+    main()